@@ -0,0 +1,303 @@
+/**
+ * @file aot.cpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief Ahead-of-time compilation of brainfuck to cached shared objects.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#include "aot.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define AOT_CC "cc"
+#define AOT_SYMBOL "bf_aot_run"
+#define AOT_EXTENT "bf_aot_extent"
+#define AOT_ABI 3	// bump when generated code changes its interface
+
+#ifndef BFI_VERSION
+#define BFI_VERSION "unknown"
+#endif
+
+// prepended to every generated file after the cell typedef, must match bf_runtime
+static const char *prelude =
+	"struct bf_runtime {\n"
+	"\tvoid (*put_chr)(void *ctx, uint64_t value);\n"
+	"\tuint64_t (*get_chr)(void *ctx, uint64_t value);\n"
+	"\tuint64_t (*scan)(void *ctx, uint64_t location, int64_t stride);\n"
+	"\tvoid (*put_str)(void *ctx, const char *data, uint64_t length);\n"
+	"};\n"
+	"static inline uint64_t at(uint64_t p, int64_t o, uint64_t n) {\n"
+	"\tuint64_t d = (o < 0) ? -(uint64_t)o : (uint64_t)o;\n"
+	"\tif (d >= n) d %= n;\n"
+	"\tif (o >= 0) return (p + d >= n) ? p + d - n : p + d;\n"
+	"\treturn (p >= d) ? p - d : p + n - d;\n"
+	"}\n"
+	"#define TRACK(x) do { uint64_t r = (x) + sh; if (r >= n) r -= n; if (r < lo) lo = r; if (r > hi) hi = r; } while (0)\n";
+
+std::string cache_path(const std::string &src, int cell_bits);
+int make_dirs(const std::string &path);
+int run_cc(const std::string &out, const std::string &src);
+void translate(const bf_program &prog, int cell_bits, std::ostream &out);
+int open_module(const std::string &path, bf_aot_module &mod);
+
+int bf_aot_load(const std::string &src, int cell_bits, bf_aot_module &mod) {
+	std::string path = cache_path(src, cell_bits);
+	if (path.empty() || access(path.c_str(), R_OK) < 0) return -1;
+
+	return open_module(path, mod);
+}
+
+int bf_aot_build(const std::string &src, const bf_program &prog, int cell_bits, bf_aot_module &mod) {
+	std::string path = cache_path(src, cell_bits);
+	if (path.empty() || make_dirs(path.substr(0, path.rfind('/'))) < 0) {
+		std::cerr << "Cannot create cache directory" << std::endl;
+		return -1;
+	}
+
+	// build under temporary names so concurrent runs never see partial files;
+	// the source name is unique and the object takes the same stem
+	std::string c_path = path + ".XXXXXX.c";
+	int c_fd = mkstemps(&c_path[0], 2);
+	if (c_fd < 0) {
+		std::cerr << "Cannot create " << c_path << std::endl;
+		return -1;
+	}
+	close(c_fd);
+
+	std::string tmp = c_path.substr(0, c_path.size() - 2);
+	{
+		std::ofstream c_file(c_path);
+		translate(prog, cell_bits, c_file);
+		if (!c_file) {
+			std::cerr << "Cannot write " << c_path << std::endl;
+			std::remove(c_path.c_str());
+			return -1;
+		}
+	}
+
+	int status = run_cc(tmp, c_path);
+	std::remove(c_path.c_str());
+	if (status < 0 || std::rename(tmp.c_str(), path.c_str()) < 0) {
+		std::cerr << "Failed to compile program with " AOT_CC << std::endl;
+		std::remove(tmp.c_str());
+		return -1;
+	}
+
+	return open_module(path, mod);
+}
+
+void bf_aot_free(bf_aot_module &mod) {
+	if (mod.handle) dlclose(mod.handle);
+	mod.handle = NULL;
+	mod.fn = NULL;
+}
+
+/** Internal Functions **/
+
+/**
+ * @brief Get the cache file for a program.
+ * Lives in $XDG_CACHE_HOME/bfi (or ~/.cache/bfi), named after a FNV-1a hash
+ * of the source and the bfi version, the cell width and the interface version.
+ * 
+ * @param src brainfuck source
+ * @param cell_bits cell width
+ * @return shared object path or empty string if there is no cache directory
+ */
+std::string cache_path(const std::string &src, int cell_bits) {
+	std::string dir;
+	const char *xdg = std::getenv("XDG_CACHE_HOME");
+	const char *home = std::getenv("HOME");
+
+	if (xdg && *xdg) {
+		dir = std::string(xdg) + "/bfi";
+	} else if (home && *home) {
+		dir = std::string(home) + "/.cache/bfi";
+	} else {
+		return "";
+	}
+
+	// the version separates caches of different builds even if AOT_ABI is not bumped
+	uint64_t hash = 0xcbf29ce484222325;
+	for (unsigned char c : src + '\0' + BFI_VERSION) {
+		hash ^= c;
+		hash *= 0x100000001b3;
+	}
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "/%016llx-%d-%d.so", (unsigned long long)hash, cell_bits, AOT_ABI);
+	return dir + name;
+}
+
+/**
+ * @brief Create a directory and its parents.
+ * 
+ * @param path directory path
+ * @return 0 - success; -1 - error
+ */
+int make_dirs(const std::string &path) {
+	for (size_t i = 1; i <= path.size(); i++) {
+		if (i != path.size() && path[i] != '/') continue;
+		std::string part = path.substr(0, i);
+		if (mkdir(part.c_str(), 0755) < 0 && errno != EEXIST) return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Compile a C file to a shared object.
+ * Runs the compiler directly rather than through a shell, so paths need no
+ * quoting.
+ * 
+ * @param out shared object path
+ * @param src C file path
+ * @return 0 - success; -1 - error
+ */
+int run_cc(const std::string &out, const std::string &src) {
+	const char *argv[] = {
+		AOT_CC, "-O2", "-shared", "-fPIC", "-o", out.c_str(), src.c_str(), NULL
+	};
+
+	pid_t pid = fork();
+	if (pid < 0) return -1;
+	if (pid == 0) {
+		execvp(argv[0], (char *const *)argv);
+		_exit(127);
+	}
+
+	int status;
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR) return -1;
+	}
+
+	return (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+/**
+ * @brief Write program as a C translation unit.
+ * 
+ * @param prog compiled (unbound) program
+ * @param cell_bits cell width
+ * @param out output stream
+ */
+void translate(const bf_program &prog, int cell_bits, std::ostream &out) {
+	out << "#include <stdint.h>\n";
+	out << "typedef uint" << cell_bits << "_t cell;\n";
+	out << prelude;
+	out << "const int64_t " AOT_EXTENT "[2] = { " << prog.min_off << "LL, " << prog.max_off << "LL };\n";
+	out << "uint64_t " AOT_SYMBOL "(cell *m, uint64_t p, uint64_t n, void *ctx, const struct bf_runtime *rt, uint64_t *bounds) {\n";
+	out << "\tuint64_t lo = bounds[0], hi = bounds[1], sh = bounds[2];\n";
+
+	std::string indent = "\t";
+	std::set<uint64_t> labels;	// direct loops entered from a guard
+	for (uint64_t i = 0; i < prog.code.size(); i++) {
+		const bf_instr &in = prog.code[i];
+		std::ostringstream cell;
+		cell << "m[at(p, " << in.off << "LL, n)]";
+		std::ostringstream direct;
+		direct << "m[p + " << in.off << "LL]";
+
+		switch (in.op) {
+			case OP_ADD:
+				out << indent << cell.str() << " += (cell)" << in.arg << "LL;\n";
+				break;
+			case OP_MOVE:
+				out << indent << "p = at(p, " << in.arg << "LL, n);\n";
+				out << indent << "TRACK(p);\n";
+				break;
+			case OP_SET:
+				out << indent << cell.str() << " = (cell)" << in.arg << "LL;\n";
+				break;
+			case OP_MUL:
+				out << indent << cell.str() << " += (cell)(" << in.arg << "ULL * m[at(p, " << in.src << "LL, n)]);\n";
+				break;
+			case OP_SCAN:
+				out << indent << "p = rt->scan(ctx, p, " << in.arg << "LL);\n";
+				out << indent << "TRACK(p);\n";
+				break;
+			case OP_PUT_CHR:
+				out << indent << "rt->put_chr(ctx, " << cell.str() << ");\n";
+				break;
+			case OP_GET_CHR:
+				out << indent << cell.str() << " = (cell)rt->get_chr(ctx, " << cell.str() << ");\n";
+				break;
+			case OP_JMP_FWD:
+				if (labels.count(i)) out << indent << "direct" << i << ":\n";
+				out << indent << "while (m[p]) {\n";
+				indent += "\t";
+				break;
+			case OP_JMP_BCK:
+				indent.pop_back();
+				out << indent << "}\n";
+				break;
+			case OP_GUARD:
+				labels.insert(in.jump + 1);
+				out << indent << "if (p + " << in.arg << "LL < n && p + " << in.off << "LL < n) {\n";
+				out << indent << "\tTRACK(p + " << in.arg << "LL);\n";
+				out << indent << "\tTRACK(p + " << in.off << "LL);\n";
+				out << indent << "\tgoto direct" << in.jump + 1 << ";\n";
+				out << indent << "}\n";
+				break;
+			case OP_ADD_DIRECT:
+				out << indent << direct.str() << " += (cell)" << in.arg << "LL;\n";
+				break;
+			case OP_MOVE_DIRECT:
+				out << indent << "p += " << in.arg << "LL;\n";
+				break;
+			case OP_SET_DIRECT:
+				out << indent << direct.str() << " = (cell)" << in.arg << "LL;\n";
+				break;
+			case OP_MUL_DIRECT:
+				out << indent << direct.str() << " += (cell)(" << in.arg << "ULL * m[p + " << in.src << "LL]);\n";
+				break;
+			case OP_PUT_STR:
+				out << indent << "rt->put_str(ctx, \"";
+				for (unsigned char c : prog.text.substr(in.jump, in.arg)) {
+					char esc[8];
+					std::snprintf(esc, sizeof(esc), "\\%03o", c);
+					out << esc;
+				}
+				out << "\", " << in.arg << "ULL);\n";
+				break;
+		}
+	}
+
+	out << "\tbounds[0] = lo;\n\tbounds[1] = hi;\n";
+	out << "\treturn p;\n}\n";
+}
+
+/**
+ * @brief Open a shared object and look up the entry point and offset range.
+ * 
+ * @param path shared object path
+ * @param mod output module
+ * @return 0 - success; -1 - error
+ */
+int open_module(const std::string &path, bf_aot_module &mod) {
+	mod.handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (mod.handle == NULL) return -1;
+
+	mod.fn = (bf_aot_fn)dlsym(mod.handle, AOT_SYMBOL);
+	const int64_t *extent = (const int64_t *)dlsym(mod.handle, AOT_EXTENT);
+	if (mod.fn == NULL || extent == NULL) {
+		bf_aot_free(mod);
+		return -1;
+	}
+	mod.min_off = extent[0];
+	mod.max_off = extent[1];
+
+	return 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * @file aot.hpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief Ahead-of-time compilation of brainfuck to cached shared objects.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef BFI_AOT_HPP
+#define BFI_AOT_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "compiler.hpp"
+
+/**
+ * @brief Compiled function: runs the program and returns the final pointer.
+ * bounds holds the lowest and highest pointer locations reached, and is
+ * widened by every MOVE and SCAN. Locations are rotated by bounds[2] first:
+ * (location + bounds[2]) % memsize.
+ * 
+ */
+typedef uint64_t (*bf_aot_fn)(void *mem, uint64_t ptr, uint64_t memsize, void *ctx, const bf_runtime *rt, uint64_t *bounds);
+
+/**
+ * @brief Loaded shared object.
+ * 
+ */
+struct bf_aot_module {
+	bf_aot_fn fn;
+	void *handle;
+	int64_t min_off;	// see bf_program
+	int64_t max_off;
+};
+
+/**
+ * @brief Load a previously compiled program from the cache.
+ * 
+ * @param src brainfuck source, used as the cache key
+ * @param cell_bits cell width, part of the cache key
+ * @param mod output module
+ * @return 0 - success; -1 - not cached
+ */
+int bf_aot_load(const std::string &src, int cell_bits, bf_aot_module &mod);
+
+/**
+ * @brief Translate a program to C, build it with the system compiler and load it.
+ * The shared object is stored in the cache for bf_aot_load.
+ * 
+ * @param src brainfuck source, used as the cache key
+ * @param prog compiled (unbound) program
+ * @param cell_bits cell width, part of the cache key
+ * @param mod output module
+ * @return 0 - success; -1 - error
+ */
+int bf_aot_build(const std::string &src, const bf_program &prog, int cell_bits, bf_aot_module &mod);
+
+/**
+ * @brief Unload a module.
+ * 
+ * @param mod module
+ */
+void bf_aot_free(bf_aot_module &mod);
+
+#endif // BFI_AOT_HPP
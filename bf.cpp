@@ -11,177 +11,986 @@
 
 #include <iostream>
 #include <istream>
-#include <stack>
+#include <iterator>
+#include <new>
+#include <string>
+#include <string_view>
+#include <cstdio>
 #include <cstring>
+#include <vector>
 #include <unistd.h>
 
-// brainfuck commands
-#define PTR_INC '>'
-#define PTR_DEC '<'
-#define MEM_INC '+'
-#define MEM_DEC '-'
-#define PUT_CHR '.'
-#define GET_CHR ','
-#define JMP_FWD '['
-#define JMP_BCK ']'
-
-// brainfuck memory
-static uint8_t *mem;
-static uint64_t memsize;
-static uint64_t ptr;
-static std::stack<uint64_t> goto_stack;
-
-int verify(std::istream &code);
-int jump_ff(std::istream &code);
+#include "aot.hpp"
+#include "compiler.hpp"
+#include "io.hpp"
+#include "jit.hpp"
+#include "tape.hpp"
+
+/**
+ * @brief Cells copied into a snapshot.
+ * 
+ */
+struct saved_run {
+	uint64_t start;
+	uint64_t count;
+};
+
+/**
+ * @brief Saved memory state: the touched window and the committed cells in it.
+ * 
+ */
+struct snapshot {
+	bool valid = false;
+	uint64_t ptr;
+	int64_t dirty_lo;
+	int64_t dirty_hi;
+	std::vector<saved_run> runs;
+	std::vector<uint8_t> cells;
+};
+
+/**
+ * @brief Everything a machine owns.
+ * 
+ */
+struct bf_state {
+	// brainfuck memory
+	bf_tape tape = {};
+	uint64_t ptr = 0;
+	enum bf_engine engine = ENGINE_SWITCH;
+	enum bf_hugepages hugepages = HUGEPAGES_AUTO;
+	enum bf_eof eof = EOF_UNCHANGED;
+
+	// touched memory: cells [dirty_lo, dirty_hi] before wrapping, empty if lo > hi
+	int64_t dirty_lo = 0;
+	int64_t dirty_hi = -1;
+
+	// lowest and highest pointer locations of the current run, rotated by
+	// bounds[2] so the window around the starting location does not wrap
+	uint64_t bounds[3];
+
+	snapshot saved;
+	bf_program prog;	// last program run
+	bf_io io;
+};
+
+int run(bf_state &s, std::string_view code);
+int compile(std::string_view code, bf_program &prog);
+int exec_aot(bf_state &s, bf_aot_module &mod);
+template <typename Cell> uint64_t exec(bf_state &s, const bf_program &prog, bool ring, uint64_t p);
+template <typename Cell, bool Ring> uint64_t exec_switch(bf_state &s, const bf_program &prog, uint64_t p);
+template <typename Cell, bool Ring> uint64_t exec_threaded(bf_state &s, const bf_program &prog, uint64_t p);
+void put_chr(bf_state &s, uint64_t value);
+uint64_t get_chr(bf_state &s, uint64_t value);
+void put_str(bf_state &s, const char *data, uint64_t length);
+void rt_put_chr(void *ctx, uint64_t value);
+uint64_t rt_get_chr(void *ctx, uint64_t value);
+uint64_t rt_scan(void *ctx, uint64_t location, int64_t stride);
+void rt_put_str(void *ctx, const char *data, uint64_t length);
+uint64_t at(uint64_t location, uint64_t offset, uint64_t size);
+template <bool Ring> uint64_t loc(uint64_t location, uint64_t offset, uint64_t size);
+template <typename Cell> uint64_t scan(const bf_tape &tape, uint64_t location, int64_t stride);
+void start_bounds(bf_state &s);
+void track(uint64_t location, uint64_t shift, uint64_t size, uint64_t &lo, uint64_t &hi);
+void mark_touched(bf_state &s, int64_t min_off, int64_t max_off);
+void clear_touched(bf_state &s);
+int touched_pieces(const bf_state &s, uint64_t start[2], uint64_t count[2]);
+
+static const bf_runtime runtime = { rt_put_chr, rt_get_chr, rt_scan, rt_put_str };
+
+namespace bf {
+
+Machine::Machine() : state(new bf_state) {}
+
+Machine::~Machine() {
+	stop_writer();
+	close_input();
+	free();
+}
+
+uint64_t Machine::ptr() const {
+	return state->ptr;
+}
+
+uint64_t Machine::memsize() const {
+	return state->tape.size;
+}
+
+int Machine::cellbits() const {
+	return state->tape.cell_size * 8;
+}
+
+uint64_t Machine::hugebytes() const {
+	return bf_tape_huge_bytes(state->tape);
+}
+
+uint64_t Machine::value() const {
+	return value(state->ptr);
+}
+
+uint64_t Machine::value(uint64_t location) const {
+	const bf_tape &tape = state->tape;
+	if (tape.mem == NULL) return 0;
+
+	switch (tape.cell_size) {
+		case 2: return ((uint16_t *)tape.mem)[location];
+		case 4: return ((uint32_t *)tape.mem)[location];
+		case 8: return ((uint64_t *)tape.mem)[location];
+		default: return tape.mem[location];
+	}
+}
+
+uint64_t Machine::ptroffset(int64_t offset) const {
+	const uint64_t ptr = state->ptr;
+	const uint64_t size = state->tape.size;
+	if (offset == 0 || size == 0) return ptr;
+
+	uint64_t offset_abs = (offset < 0) ? -(uint64_t)offset : offset;
+	offset_abs %= size;
+
+	if (offset > 0) {
+		uint64_t diff = size - ptr;
+		if (diff > offset_abs) return ptr + offset_abs;
+		return 0 + (offset_abs - diff);
+	}
+
+	uint64_t diff = ptr;
+	if (diff >= offset_abs) return ptr - offset_abs;
+	return size - (offset_abs - diff);
+}
+
+int Machine::alloc(uint64_t size, enum bf_memory type, int cell_bits) {
+	if (cell_bits != 8 && cell_bits != 16 && cell_bits != 32 && cell_bits != 64) {
+		return -1;
+	}
+
+	bf_state &s = *state;
+	bf_tape_free(s.tape);
+	s.ptr = 0;
+	s.dirty_lo = 0;
+	s.dirty_hi = -1;
+	s.saved.valid = false;
+	s.saved.cells.clear();
+	s.saved.runs.clear();
+
+	if (type == MEMORY_UNBOUNDED) return bf_tape_alloc_unbounded(s.tape, cell_bits / 8);
+	return bf_tape_alloc(s.tape, size, cell_bits / 8, s.hugepages);
+}
+
+void Machine::set_hugepages(enum bf_hugepages policy) {
+	state->hugepages = policy;
+}
+
+void Machine::free() {
+	bf_state &s = *state;
+	bf_tape_free(s.tape);
+	s.tape = bf_tape();
+	s.ptr = 0;
+	s.dirty_lo = 0;
+	s.dirty_hi = -1;
+	s.saved.valid = false;
+	s.saved.cells.clear();
+	s.saved.runs.clear();
+}
+
+void Machine::reset() {
+	clear_touched(*state);
+	state->ptr = 0;
+}
+
+int Machine::snapshot() {
+	bf_state &s = *state;
+	if (s.tape.mem == NULL) return -1;
+
+	uint64_t start[2];
+	uint64_t count[2];
+	int pieces = touched_pieces(s, start, count);
+
+	// cells of unbounded memory that were never committed are left out
+	std::vector<saved_run> runs;
+	uint64_t total = 0;
+	for (int i = 0; i < pieces; i++) {
+		uint64_t pos = start[i];
+		uint64_t end = start[i] + count[i];
+		while (pos < end) {
+			bool committed;
+			uint64_t len = bf_tape_run(s.tape, pos, end - pos, committed);
+			if (committed) {
+				runs.push_back({ pos, len });
+				total += len;
+			}
+			pos += len;
+		}
+	}
+
+	if (total > SIZE_MAX / s.tape.cell_size) return -1;
+	std::vector<uint8_t> cells;
+	try {
+		cells.resize(total * s.tape.cell_size);
+	} catch (const std::bad_alloc &) {
+		return -1;
+	}
+
+	uint8_t *dst = cells.data();
+	for (const saved_run &run : runs) {
+		uint64_t bytes = run.count * s.tape.cell_size;
+		std::memcpy(dst, s.tape.mem + run.start * s.tape.cell_size, bytes);
+		dst += bytes;
+	}
+
+	s.saved.ptr = s.ptr;
+	s.saved.dirty_lo = s.dirty_lo;
+	s.saved.dirty_hi = s.dirty_hi;
+	s.saved.runs.swap(runs);
+	s.saved.cells.swap(cells);
+	s.saved.valid = true;
+	return 0;
+}
+
+int Machine::restore() {
+	bf_state &s = *state;
+	if (!s.saved.valid) return -1;
+
+	// everything outside the saved runs is zero in the snapshot
+	clear_touched(s);
+
+	const uint8_t *src = s.saved.cells.data();
+	for (const saved_run &run : s.saved.runs) {
+		uint64_t bytes = run.count * s.tape.cell_size;
+		std::memcpy(s.tape.mem + run.start * s.tape.cell_size, src, bytes);
+		src += bytes;
+	}
+	s.ptr = s.saved.ptr;
+	s.dirty_lo = s.saved.dirty_lo;
+	s.dirty_hi = s.saved.dirty_hi;
+	return 0;
+}
+
+void Machine::set_eof(enum bf_eof mode) {
+	state->eof = mode;
+}
+
+void Machine::set_engine(enum bf_engine type) {
+	state->engine = type;
+}
+
+int Machine::open_input(const char *path) {
+	return bf_in_open(state->io, path);
+}
+
+void Machine::close_input() {
+	bf_in_close(state->io);
+}
+
+void Machine::set_output(int fd) {
+	bf_out_set_fd(state->io, fd);
+}
+
+int Machine::start_writer() {
+	return bf_out_start_writer(state->io);
+}
+
+void Machine::stop_writer() {
+	bf_out_stop_writer(state->io);
+}
+
+int Machine::execute(std::istream &code) {
+	std::string src(std::istreambuf_iterator<char>(code), {});
+	return execute(std::string_view(src));
+}
+
+int Machine::execute(std::string_view code) {
+	// output so far goes through stdio, keep it in order with the buffer
+	if (state->io.out_fd == STDOUT_FILENO) std::fflush(stdout);
+	int status = run(*state, code);
+	bf_out_drain(state->io);
+
+	return status;
+}
+
+Machine &default_machine() {
+	static Machine machine;
+	return machine;
+}
+
+} // namespace bf
 
 uint64_t bf_ptr() {
-	return ptr;
+	return bf::default_machine().ptr();
 }
 
 uint64_t bf_memsize() {
-	return memsize;
+	return bf::default_machine().memsize();
+}
+
+int bf_cellbits() {
+	return bf::default_machine().cellbits();
+}
+
+uint64_t bf_hugebytes() {
+	return bf::default_machine().hugebytes();
+}
+
+uint64_t bf_value() {
+	return bf::default_machine().value();
 }
 
-uint8_t bf_value() {
-	return mem[ptr];
+uint64_t bf_value(uint64_t location) {
+	return bf::default_machine().value(location);
 }
 
-uint8_t bf_value(uint64_t location) {
-	return mem[location];
+uint64_t bf_ptroffset(int64_t offset) {
+	return bf::default_machine().ptroffset(offset);
+}
+
+int bf_malloc(uint64_t size, enum bf_memory type, int cell_bits) {
+	return bf::default_machine().alloc(size, type, cell_bits);
+}
+
+void bf_set_hugepages(enum bf_hugepages policy) {
+	bf::default_machine().set_hugepages(policy);
+}
+
+void bf_free() {
+	bf::default_machine().free();
+}
+
+void bf_reset() {
+	bf::default_machine().reset();
+}
+
+int bf_snapshot() {
+	return bf::default_machine().snapshot();
+}
+
+int bf_restore() {
+	return bf::default_machine().restore();
+}
+
+void bf_set_eof(enum bf_eof mode) {
+	bf::default_machine().set_eof(mode);
+}
+
+void bf_set_engine(enum bf_engine type) {
+	bf::default_machine().set_engine(type);
 }
 
 int bf_execute(std::istream &code) {
-	if (!verify(code)) {
+	return bf::default_machine().execute(code);
+}
+
+int bf_execute(std::string_view code) {
+	return bf::default_machine().execute(code);
+}
+
+int bf_open_input(const char *path) {
+	return bf::default_machine().open_input(path);
+}
+
+void bf_close_input() {
+	bf::default_machine().close_input();
+}
+
+void bf_set_output(int fd) {
+	bf::default_machine().set_output(fd);
+}
+
+int bf_start_writer() {
+	return bf::default_machine().start_writer();
+}
+
+void bf_stop_writer() {
+	bf::default_machine().stop_writer();
+}
+
+/** Internal Functions **/
+
+/**
+ * @brief Compile and run code with the selected engine.
+ * 
+ * @param s machine
+ * @param code brainfuck code
+ * @return 0 - sucess; -1 - error
+ */
+int run(bf_state &s, std::string_view code) {
+	if (s.tape.mem == NULL) return -1;
+
+	bf_program &prog = s.prog;
+	const int cell_bits = s.tape.cell_size * 8;
+	prog = bf_program();
+
+	if (s.engine == ENGINE_AOT) {
+		std::string src(code);
+		bf_aot_module mod;
+
+		start_bounds(s);
+		if (bf_aot_load(src, cell_bits, mod) == 0) return exec_aot(s, mod);
+		if (compile(code, prog) < 0) return -1;
+		if (bf_aot_build(src, prog, cell_bits, mod) == 0) return exec_aot(s, mod);
+		// build failed, interpret instead
+	} else if (compile(code, prog) < 0) {
+		return -1;
+	}
+	// memory is all zero, so the start of the program can be run right away
+	if (s.dirty_lo > s.dirty_hi) bf_fold(prog, s.ptr, s.tape.size, cell_bits);
+	bf_bind(prog, s.tape.size);
+	bool ring = (s.tape.type == TAPE_RING);
+	start_bounds(s);
+
+	if (s.engine == ENGINE_JIT && s.tape.cell_size == 1) {
+		bf_jit_code jit;
+		if (bf_jit_compile(prog, runtime, ring, jit) == 0) {
+			s.ptr = jit.fn(s.tape.mem, s.ptr, s.tape.size, &s, s.bounds);
+			bf_jit_free(jit);
+			mark_touched(s, prog.min_off, prog.max_off);
+			return 0;
+		}
+		// unsupported architecture, interpret instead
+	}
+
+	switch (s.tape.cell_size) {
+		case 2: s.ptr = exec<uint16_t>(s, prog, ring, s.ptr); break;
+		case 4: s.ptr = exec<uint32_t>(s, prog, ring, s.ptr); break;
+		case 8: s.ptr = exec<uint64_t>(s, prog, ring, s.ptr); break;
+		default: s.ptr = exec<uint8_t>(s, prog, ring, s.ptr); break;
+	}
+	mark_touched(s, prog.min_off, prog.max_off);
+
+	return 0;
+}
+
+/**
+ * @brief Compile code, reporting invalid code.
+ * 
+ * @param code brainfuck code
+ * @param prog output program
+ * @return 0 - success; -1 - invalid code
+ */
+int compile(std::string_view code, bf_program &prog) {
+	if (bf_compile(code, prog) < 0) {
 		std::cerr << "Inputted code is invalid" << std::endl;
 		return -1;
 	}
 
-	code.clear();
-	code.seekg(0);
+	return 0;
+}
+
+/**
+ * @brief Run and unload a compiled shared object.
+ * 
+ * @param s machine
+ * @param mod loaded module
+ * @return 0
+ */
+int exec_aot(bf_state &s, bf_aot_module &mod) {
+	s.ptr = mod.fn(s.tape.mem, s.ptr, s.tape.size, &s, &runtime, s.bounds);
+	mark_touched(s, mod.min_off, mod.max_off);
+	bf_aot_free(mod);
+	return 0;
+}
 
-	char cmd;
+/**
+ * @brief Run program with the selected interpreter engine.
+ * 
+ * @tparam Cell cell type
+ * @param s machine
+ * @param prog bound program
+ * @param ring memory is a ring mapping
+ * @param p starting pointer location
+ * @return final pointer location
+ */
+template <typename Cell>
+uint64_t exec(bf_state &s, const bf_program &prog, bool ring, uint64_t p) {
+	if (s.engine == ENGINE_SWITCH) {
+		return ring ? exec_switch<Cell, true>(s, prog, p) : exec_switch<Cell, false>(s, prog, p);
+	}
+
+	return ring ? exec_threaded<Cell, true>(s, prog, p) : exec_threaded<Cell, false>(s, prog, p);
+}
+
+/**
+ * @brief Run program with a switch dispatch loop.
+ * 
+ * @tparam Cell cell type
+ * @tparam Ring memory is a ring mapping
+ * @param s machine
+ * @param prog bound program
+ * @param p starting pointer location
+ * @return final pointer location
+ */
+template <typename Cell, bool Ring>
+uint64_t exec_switch(bf_state &s, const bf_program &prog, uint64_t p) {
+	Cell *const mem = (Cell *)s.tape.mem;
+	const uint64_t size = s.tape.size;
+	const bf_instr *ins = prog.code.data();
+	uint64_t len = prog.code.size();
+	const uint64_t shift = s.bounds[2];
+	uint64_t lo = s.bounds[0];
+	uint64_t hi = s.bounds[1];
 
-	while (code >> cmd) {
-		uint8_t *cell = mem + ptr;
-		switch (cmd) {
-			case PTR_INC:
-				ptr = bf_ptroffset(1);
+	for (uint64_t pc = 0; pc < len; pc++) {
+		const bf_instr &in = ins[pc];
+		switch (in.op) {
+			case OP_ADD:
+				mem[loc<Ring>(p, in.off, size)] += (Cell)in.arg;
 				break;
-			case PTR_DEC:
-				ptr = bf_ptroffset(-1);
+			case OP_MOVE:
+				p = at(p, in.arg, size);
+				track(p, shift, size, lo, hi);
 				break;
-			case MEM_INC:
-				(*cell)++;
+			case OP_SET:
+				mem[loc<Ring>(p, in.off, size)] = (Cell)in.arg;
 				break;
-			case MEM_DEC:
-				(*cell)--;
+			case OP_MUL:
+				mem[loc<Ring>(p, in.off, size)] += (Cell)((uint64_t)in.arg * mem[loc<Ring>(p, in.src, size)]);
 				break;
-			case PUT_CHR:
-				std::cout << *cell;
+			case OP_SCAN:
+				p = scan<Cell>(s.tape, p, in.arg);
+				track(p, shift, size, lo, hi);
 				break;
-			case GET_CHR:
-				std::cin >> *cell;
+			case OP_PUT_CHR:
+				put_chr(s, mem[loc<Ring>(p, in.off, size)]);
 				break;
-			case JMP_FWD:
-				if (*cell != 0) {
-					goto_stack.push(code.tellg());
-				} else {
-					jump_ff(code);
-				}
+			case OP_GET_CHR:
+				mem[loc<Ring>(p, in.off, size)] = (Cell)get_chr(s, mem[loc<Ring>(p, in.off, size)]);
+				break;
+			case OP_JMP_FWD:
+				if (mem[p] == 0) pc = in.jump;
+				break;
+			case OP_JMP_BCK:
+				if (mem[p] != 0) pc = in.jump;
 				break;
-			case JMP_BCK:
-				if (*cell != 0) {
-					code.seekg(goto_stack.top());
-				} else {
-					goto_stack.pop();
+			case OP_GUARD:
+				if (p + in.arg < size && p + in.off < size) {
+					track(p + in.arg, shift, size, lo, hi);
+					track(p + in.off, shift, size, lo, hi);
+					pc = in.jump;
 				}
 				break;
+			case OP_ADD_DIRECT:
+				mem[p + in.off] += (Cell)in.arg;
+				break;
+			case OP_MOVE_DIRECT:
+				p += in.arg;
+				break;
+			case OP_SET_DIRECT:
+				mem[p + in.off] = (Cell)in.arg;
+				break;
+			case OP_MUL_DIRECT:
+				mem[p + in.off] += (Cell)((uint64_t)in.arg * mem[p + in.src]);
+				break;
+			case OP_PUT_STR:
+				put_str(s, prog.text.data() + in.jump, in.arg);
+				break;
 		}
 	}
 
-	return 0;
+	s.bounds[0] = lo;
+	s.bounds[1] = hi;
+	return p;
 }
 
-uint64_t bf_ptroffset(int offset) {
-	if (offset == 0) return ptr;
+/**
+ * @brief Run program with direct threading (computed goto).
+ * Every instruction is paired with the address of its handler, so each
+ * handler jumps straight to the next one without a central dispatch branch.
+ * Falls back to the switch engine on compilers without labels as values.
+ * 
+ * @tparam Cell cell type
+ * @tparam Ring memory is a ring mapping
+ * @param s machine
+ * @param prog bound program
+ * @param p starting pointer location
+ * @return final pointer location
+ */
+template <typename Cell, bool Ring>
+uint64_t exec_threaded(bf_state &s, const bf_program &prog, uint64_t p) {
+#ifdef __GNUC__
+	// must follow the order of enum bf_op
+	static const void *handlers[] = {
+		&&op_add, &&op_move, &&op_set, &&op_mul, &&op_scan,
+		&&op_put_chr, &&op_get_chr, &&op_jmp_fwd, &&op_jmp_bck,
+		&&op_guard, &&op_add_direct, &&op_move_direct, &&op_set_direct, &&op_mul_direct,
+		&&op_put_str
+	};
 
-	uint64_t offset_abs = (offset < 0) ? (-offset) : offset;
+	struct threaded_instr {
+		const void *handler;
+		bf_instr in;
+	};
 
-	if (offset > 0) {
-		uint64_t diff = memsize - ptr;
-		if (diff > offset_abs) return ptr + offset_abs;
-		return 0 + (offset_abs - diff);
+	std::vector<threaded_instr> code;
+	code.reserve(prog.code.size() + 1);
+	for (const bf_instr &in : prog.code) {
+		code.push_back({ handlers[in.op], in });
 	}
+	code.push_back({ &&op_end, bf_instr(OP_ADD) });
 
-	uint64_t diff = ptr;
-	if (diff >= offset_abs) return ptr - offset_abs;
-	return memsize - (offset_abs - diff);
+	Cell *const mem = (Cell *)s.tape.mem;
+	const uint64_t size = s.tape.size;
+	const threaded_instr *base = code.data();
+	const threaded_instr *ip = base;
+	const uint64_t shift = s.bounds[2];
+	uint64_t lo = s.bounds[0];
+	uint64_t hi = s.bounds[1];
+
+	#define DISPATCH() goto *(++ip)->handler
+
+	goto *ip->handler;
+
+op_add:
+	mem[loc<Ring>(p, ip->in.off, size)] += (Cell)ip->in.arg;
+	DISPATCH();
+op_move:
+	p = at(p, ip->in.arg, size);
+	track(p, shift, size, lo, hi);
+	DISPATCH();
+op_set:
+	mem[loc<Ring>(p, ip->in.off, size)] = (Cell)ip->in.arg;
+	DISPATCH();
+op_mul:
+	mem[loc<Ring>(p, ip->in.off, size)] += (Cell)((uint64_t)ip->in.arg * mem[loc<Ring>(p, ip->in.src, size)]);
+	DISPATCH();
+op_scan:
+	p = scan<Cell>(s.tape, p, ip->in.arg);
+	track(p, shift, size, lo, hi);
+	DISPATCH();
+op_put_chr:
+	put_chr(s, mem[loc<Ring>(p, ip->in.off, size)]);
+	DISPATCH();
+op_get_chr:
+	mem[loc<Ring>(p, ip->in.off, size)] = (Cell)get_chr(s, mem[loc<Ring>(p, ip->in.off, size)]);
+	DISPATCH();
+op_jmp_fwd:
+	if (mem[p] == 0) ip = base + ip->in.jump;
+	DISPATCH();
+op_jmp_bck:
+	if (mem[p] != 0) ip = base + ip->in.jump;
+	DISPATCH();
+op_guard:
+	if (p + ip->in.arg < size && p + ip->in.off < size) {
+		track(p + ip->in.arg, shift, size, lo, hi);
+		track(p + ip->in.off, shift, size, lo, hi);
+		ip = base + ip->in.jump;
+	}
+	DISPATCH();
+op_add_direct:
+	mem[p + ip->in.off] += (Cell)ip->in.arg;
+	DISPATCH();
+op_move_direct:
+	p += ip->in.arg;
+	DISPATCH();
+op_set_direct:
+	mem[p + ip->in.off] = (Cell)ip->in.arg;
+	DISPATCH();
+op_mul_direct:
+	mem[p + ip->in.off] += (Cell)((uint64_t)ip->in.arg * mem[p + ip->in.src]);
+	DISPATCH();
+op_put_str:
+	put_str(s, prog.text.data() + ip->in.jump, ip->in.arg);
+	DISPATCH();
+op_end:
+	#undef DISPATCH
+	s.bounds[0] = lo;
+	s.bounds[1] = hi;
+	return p;
+#else
+	return exec_switch<Cell, Ring>(s, prog, p);
+#endif
 }
 
-int bf_malloc(uint64_t size) {
-	if (mem) std::free(mem);
+/**
+ * @brief Print a cell value as a character (low byte).
+ * 
+ * @param s machine
+ * @param value cell value
+ */
+void put_chr(bf_state &s, uint64_t value) {
+	bf_out_put(s.io, (uint8_t)value);
+}
 
-	mem = (uint8_t *)std::calloc(size, sizeof(uint8_t));
-	if (mem == NULL) {
-		return -1;
+/**
+ * @brief Read a character for a cell.
+ * 
+ * @param s machine
+ * @param value current cell value
+ * @return byte read; at the end of input, as set by set_eof
+ */
+uint64_t get_chr(bf_state &s, uint64_t value) {
+	int chr = bf_in_get(s.io);
+	if (chr >= 0) return chr;
+
+	switch (s.eof) {
+		case EOF_ZERO: return 0;
+		case EOF_MINUS_ONE: return UINT64_MAX;
+		default: return value;
 	}
+}
 
-	memsize = size;
-	return 0;
+/**
+ * @brief Print literal output.
+ * 
+ * @param s machine
+ * @param data bytes
+ * @param length number of bytes
+ */
+void put_str(bf_state &s, const char *data, uint64_t length) {
+	bf_out_write(s.io, data, length);
 }
 
-void bf_free() {
-	if (mem) std::free(mem);
+/**
+ * @brief Runtime: print cell.
+ * 
+ * @param ctx machine (bf_state)
+ * @param value cell value
+ */
+void rt_put_chr(void *ctx, uint64_t value) {
+	put_chr(*(bf_state *)ctx, value);
 }
 
-void bf_reset() {
-	std::memset(mem, 0, memsize);
-	ptr = 0;
+/**
+ * @brief Runtime: read into cell.
+ * 
+ * @param ctx machine (bf_state)
+ * @param value current cell value
+ * @return new cell value
+ */
+uint64_t rt_get_chr(void *ctx, uint64_t value) {
+	return get_chr(*(bf_state *)ctx, value);
 }
 
-/** Internal Functions **/
+/**
+ * @brief Runtime: scan for a zero cell.
+ * 
+ * @param ctx machine (bf_state)
+ * @param location starting address
+ * @param stride pointer offset per step
+ * @return location of the zero cell
+ */
+uint64_t rt_scan(void *ctx, uint64_t location, int64_t stride) {
+	const bf_tape &tape = ((bf_state *)ctx)->tape;
+	switch (tape.cell_size) {
+		case 2: return scan<uint16_t>(tape, location, stride);
+		case 4: return scan<uint32_t>(tape, location, stride);
+		case 8: return scan<uint64_t>(tape, location, stride);
+		default: return scan<uint8_t>(tape, location, stride);
+	}
+}
 
 /**
- * @brief Verifies that the code stream does not have any open brackets.
+ * @brief Runtime: print literal output.
  * 
- * @param code code stream
- * @return 1 if code is valid, 0 if invalid
+ * @param ctx machine (bf_state)
+ * @param data bytes
+ * @param length number of bytes
  */
-int verify(std::istream &code) {
-	char cmd;
-	int brackets_open = 0;
+void rt_put_str(void *ctx, const char *data, uint64_t length) {
+	put_str(*(bf_state *)ctx, data, length);
+}
 
-	while (code >> cmd) {
-		switch (cmd) {
-			case JMP_FWD:
-				brackets_open++;
-				break;
-			case JMP_BCK:
-				brackets_open--;
-				break;
+/**
+ * @brief Add a bound offset to a location, wrapping around the memory.
+ * 
+ * @param location base address
+ * @param offset offset in [0, size)
+ * @param size memory size
+ * @return resulting address
+ */
+inline uint64_t at(uint64_t location, uint64_t offset, uint64_t size) {
+	uint64_t addr = location + offset;
+	return (addr >= size) ? addr - size : addr;
+}
+
+/**
+ * @brief Get the address of a cell at a bound offset from a location.
+ * A ring mapping aliases addresses up to 2 * size, so no wrapping is needed.
+ * 
+ * @tparam Ring memory is a ring mapping
+ * @param location base address
+ * @param offset offset in [0, size)
+ * @param size memory size
+ * @return address to access
+ */
+template <bool Ring>
+inline uint64_t loc(uint64_t location, uint64_t offset, uint64_t size) {
+	if (Ring) return location + offset;
+	return at(location, offset, size);
+}
+
+/**
+ * @brief Move from a location by stride until a zero cell is found.
+ * Wraps around the memory like ptroffset and never returns if there is no
+ * reachable zero cell, same as the loop it replaces.
+ * 
+ * @tparam Cell cell type
+ * @param tape memory
+ * @param location starting address
+ * @param stride pointer offset per step
+ * @return location of the zero cell
+ */
+template <typename Cell>
+uint64_t scan(const bf_tape &tape, uint64_t location, int64_t stride) {
+	Cell *const mem = (Cell *)tape.mem;
+	const uint64_t size = tape.size;
+	uint64_t p = location;
+
+	// byte cells can use the C library search functions
+	if (sizeof(Cell) == 1 && stride == 1) {
+		while (1) {
+			void *hit = std::memchr(mem + p, 0, size - p);
+			if (hit != NULL) return (Cell *)hit - mem;
+			p = 0;
+		}
+	}
+
+	if (sizeof(Cell) == 1 && stride == -1) {
+		while (1) {
+			#ifdef __GLIBC__
+			void *hit = memrchr(mem, 0, p + 1);
+			if (hit != NULL) return (Cell *)hit - mem;
+			#else
+			for (uint64_t i = p + 1; i-- > 0;) {
+				if (mem[i] == 0) return i;
+			}
+			#endif
+			p = size - 1;
 		}
 	}
 
-	return (brackets_open == 0);
+	// moving back by n is the same as moving forward by size - n
+	uint64_t step = (stride < 0) ? -(uint64_t)stride : stride;
+	step %= size;
+	if (stride < 0 && step != 0) step = size - step;
+
+	while (mem[p] != 0) {
+		p += step;
+		if (p >= size) p -= size;
+	}
+
+	return p;
+}
+
+/**
+ * @brief Start pointer bounds at the current location.
+ * Locations are rotated to put it in the middle of the memory, so a program
+ * stepping across the end of memory keeps a small window.
+ * 
+ * @param s machine
+ */
+void start_bounds(bf_state &s) {
+	const uint64_t half = s.tape.size / 2;
+	s.bounds[2] = (s.ptr <= half) ? half - s.ptr : half + s.tape.size - s.ptr;
+	s.bounds[0] = s.bounds[1] = half;
+}
+
+/**
+ * @brief Widen pointer bounds to include a location.
+ * 
+ * @param location pointer location
+ * @param shift rotation (bounds[2])
+ * @param size memory size
+ * @param lo lowest rotated location
+ * @param hi highest rotated location
+ */
+inline void track(uint64_t location, uint64_t shift, uint64_t size, uint64_t &lo, uint64_t &hi) {
+	uint64_t rotated = at(location, shift, size);
+	if (rotated < lo) lo = rotated;
+	if (rotated > hi) hi = rotated;
 }
 
 /**
- * @brief Fast forward code stream to the matching closed bracket.
+ * @brief Add the cells reachable from the pointer bounds to the touched window.
  * 
- * @param code code stream
- * @return 0 on success or -1 on EOF
+ * @param s machine
+ * @param min_off lowest offset written by the program
+ * @param max_off highest offset written by the program
  */
-int jump_ff(std::istream &code) {
-	char cmd;
-	int skip = 0;
+void mark_touched(bf_state &s, int64_t min_off, int64_t max_off) {
+	int64_t lo = (int64_t)s.bounds[0] - (int64_t)s.bounds[2] + min_off;
+	int64_t hi = (int64_t)s.bounds[1] - (int64_t)s.bounds[2] + max_off;
 
-	while (code >> cmd) {
-		if (cmd == JMP_FWD) skip++;
-		if (cmd == JMP_BCK) {
-			if (skip > 0) skip--;
-			else return 0;
+	if (s.dirty_lo > s.dirty_hi) {
+		s.dirty_lo = lo;
+		s.dirty_hi = hi;
+		return;
+	}
+
+	// both windows lie on a ring, join them the way that covers the fewest cells
+	const int64_t size = s.tape.size;
+	int64_t best_lo = 0, best_hi = -1;
+	for (int64_t turn = -size; turn <= size; turn += size) {
+		int64_t join_lo = (lo + turn < s.dirty_lo) ? lo + turn : s.dirty_lo;
+		int64_t join_hi = (hi + turn > s.dirty_hi) ? hi + turn : s.dirty_hi;
+		if (best_lo > best_hi || join_hi - join_lo < best_hi - best_lo) {
+			best_lo = join_lo;
+			best_hi = join_hi;
 		}
 	}
 
-	return -1;
+	// keep the window start within the memory so it cannot drift
+	int64_t start = ((best_lo % size) + size) % size;
+	s.dirty_lo = start;
+	s.dirty_hi = best_hi + (start - best_lo);
+}
+
+/**
+ * @brief Zero the touched window.
+ * 
+ * @param s machine
+ */
+void clear_touched(bf_state &s) {
+	uint64_t start[2], count[2];
+	int pieces = touched_pieces(s, start, count);
+
+	if (pieces == 1 && count[0] == s.tape.size) {
+		bf_tape_clear(s.tape);
+	} else {
+		// memory that was never committed is zero already
+		for (int i = 0; i < pieces; i++) {
+			uint64_t pos = start[i];
+			uint64_t end = start[i] + count[i];
+			while (pos < end) {
+				bool committed;
+				uint64_t len = bf_tape_run(s.tape, pos, end - pos, committed);
+				if (committed) bf_tape_clear_range(s.tape, pos, len);
+				pos += len;
+			}
+		}
+	}
+
+	s.dirty_lo = 0;
+	s.dirty_hi = -1;
+}
+
+/**
+ * @brief Split the touched window into cell ranges, wrapping it around the
+ * memory.
+ * 
+ * @param s machine
+ * @param start output first cell of each range
+ * @param count output number of cells in each range
+ * @return number of ranges (0 - 2)
+ */
+int touched_pieces(const bf_state &s, uint64_t start[2], uint64_t count[2]) {
+	if (s.dirty_lo > s.dirty_hi) return 0;
+
+	const int64_t size = s.tape.size;
+	if (s.dirty_hi - s.dirty_lo + 1 >= size) {
+		start[0] = 0;
+		count[0] = size;
+		return 1;
+	}
+
+	uint64_t lo = ((s.dirty_lo % size) + size) % size;
+	uint64_t hi = ((s.dirty_hi % size) + size) % size;
+	if (lo <= hi) {
+		start[0] = lo;
+		count[0] = hi - lo + 1;
+		return 1;
+	}
+
+	start[0] = lo;
+	count[0] = size - lo;
+	start[1] = 0;
+	count[1] = hi + 1;
+	return 2;
 }
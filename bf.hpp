@@ -10,7 +10,249 @@
 #ifndef BFI_BF_HPP
 #define BFI_BF_HPP
 
+#include <cstdint>
 #include <istream>
+#include <memory>
+#include <string_view>
+
+/**
+ * @brief Execution engines.
+ * 
+ */
+enum bf_engine {
+	ENGINE_SWITCH,
+	ENGINE_THREADED,
+	ENGINE_JIT,
+	ENGINE_AOT
+};
+
+/**
+ * @brief Memory modes.
+ * 
+ */
+enum bf_memory {
+	MEMORY_FIXED,		// fixed size, pointer wraps around
+	MEMORY_UNBOUNDED	// large reserved range, committed as it is used
+};
+
+/**
+ * @brief Huge page policies for allocated memory.
+ * 
+ */
+enum bf_hugepages {
+	HUGEPAGES_AUTO,		// transparent huge pages for large memory
+	HUGEPAGES_NEVER,	// regular pages only
+	HUGEPAGES_ALWAYS	// reserved huge pages if available, otherwise transparent ones
+};
+
+/**
+ * @brief Cell values stored by an input read at the end of input.
+ * 
+ */
+enum bf_eof {
+	EOF_UNCHANGED,	// leave the cell as it is
+	EOF_ZERO,		// set to 0
+	EOF_MINUS_ONE	// set to -1 (all bits set)
+};
+
+struct bf_state;
+
+namespace bf {
+
+/**
+ * @brief A brainfuck machine: memory, pointer, settings and I/O endpoints.
+ * Machines share nothing, so separate machines can run on separate threads.
+ * A single machine must not be used from several threads at once.
+ * 
+ */
+class Machine {
+public:
+	Machine();
+	~Machine();
+	Machine(const Machine &) = delete;
+	Machine &operator=(const Machine &) = delete;
+
+	/**
+	 * @brief Get current pointer location.
+	 * 
+	 * @return pointer address
+	 */
+	uint64_t ptr() const;
+
+	/**
+	 * @brief Get memory size.
+	 * 
+	 * @return memory size
+	 */
+	uint64_t memsize() const;
+
+	/**
+	 * @brief Get cell width.
+	 * 
+	 * @return cell width in bits
+	 */
+	int cellbits() const;
+
+	/**
+	 * @brief Get the amount of memory backed by huge pages.
+	 * 
+	 * @return size in bytes
+	 */
+	uint64_t hugebytes() const;
+
+	/**
+	 * @brief Get memory value at current location.
+	 * 
+	 * @return value
+	 */
+	uint64_t value() const;
+
+	/**
+	 * @brief Get memory value at location.
+	 * 
+	 * @param location address
+	 * @return value
+	 */
+	uint64_t value(uint64_t location) const;
+
+	/**
+	 * @brief Get pointer offset from current pointer.
+	 * 
+	 * @param offset
+	 * @return new pointer location
+	 */
+	uint64_t ptroffset(int64_t offset) const;
+
+	/**
+	 * @brief Allocate memory, replacing any previous memory.
+	 * Where supported, memory is a ring mapping and size is rounded up to a
+	 * page multiple (see memsize).
+	 * 
+	 * @param size memory size in cells (ignored for unbounded memory)
+	 * @param type memory mode
+	 * @param cell_bits cell width: 8, 16, 32 or 64
+	 * @return 0 - success; -1 - error
+	 */
+	int alloc(uint64_t size, enum bf_memory type = MEMORY_FIXED, int cell_bits = 8);
+
+	/**
+	 * @brief Select the huge page policy used by alloc.
+	 * 
+	 * @param policy huge page policy
+	 */
+	void set_hugepages(enum bf_hugepages policy);
+
+	/**
+	 * @brief Free memory. The pointer and the snapshot are dropped with it.
+	 * 
+	 */
+	void free();
+
+	/**
+	 * @brief Reset memory.
+	 * 
+	 */
+	void reset();
+
+	/**
+	 * @brief Save memory and pointer location.
+	 * Costs as much as the memory touched since the last allocation or reset,
+	 * not the memory size. Replaces the previous snapshot.
+	 * 
+	 * @return 0 - success; -1 - no memory allocated or not enough memory to hold it
+	 */
+	int snapshot();
+
+	/**
+	 * @brief Return memory and pointer location to the last snapshot.
+	 * Can be repeated to run several continuations from the same state.
+	 * 
+	 * @return 0 - success; -1 - no snapshot
+	 */
+	int restore();
+
+	/**
+	 * @brief Select what input reads store at the end of input.
+	 * 
+	 * @param mode end of input behavior
+	 */
+	void set_eof(enum bf_eof mode);
+
+	/**
+	 * @brief Select the engine used by execute.
+	 * 
+	 * @param type engine
+	 */
+	void set_engine(enum bf_engine type);
+
+	/**
+	 * @brief Read input from a file instead of stdin.
+	 * 
+	 * @param path file path
+	 * @return 0 - success; -1 - error (see errno)
+	 */
+	int open_input(const char *path);
+
+	/**
+	 * @brief Release the input file and go back to stdin.
+	 * 
+	 */
+	void close_input();
+
+	/**
+	 * @brief Write output to a file descriptor instead of stdout.
+	 * Output so far is written to the old one first. The descriptor stays
+	 * open and owned by the caller.
+	 * 
+	 * @param fd open file descriptor
+	 */
+	void set_output(int fd);
+
+	/**
+	 * @brief Write output from a separate thread.
+	 * 
+	 * @return 0 - success; -1 - thread could not be started
+	 */
+	int start_writer();
+
+	/**
+	 * @brief Write out all output and stop the writer thread.
+	 * 
+	 */
+	void stop_writer();
+
+	/**
+	 * @brief Execute brainfuck code.
+	 * Program output is buffered and written out before returning.
+	 * 
+	 * @param code code stream
+	 * @return 0 - sucess; -1 - error or no memory allocated
+	 */
+	int execute(std::istream &code);
+
+	/**
+	 * @brief Execute brainfuck code held in memory.
+	 * Same as above, without copying the code first.
+	 * 
+	 * @param code brainfuck code
+	 * @return 0 - sucess; -1 - error or no memory allocated
+	 */
+	int execute(std::string_view code);
+
+private:
+	std::unique_ptr<bf_state> state;
+};
+
+/**
+ * @brief Get the machine used by the bf_* functions.
+ * 
+ * @return default machine
+ */
+Machine &default_machine();
+
+} // namespace bf
+
+// the bf_* functions below act on bf::default_machine()
 
 /**
  * @brief Get current pointer location.
@@ -26,12 +268,26 @@ uint64_t bf_ptr();
  */
 uint64_t bf_memsize();
 
+/**
+ * @brief Get cell width.
+ * 
+ * @return cell width in bits
+ */
+int bf_cellbits();
+
+/**
+ * @brief Get the amount of memory backed by huge pages.
+ * 
+ * @return size in bytes
+ */
+uint64_t bf_hugebytes();
+
 /**
  * @brief Get memory value at current location.
  * 
  * @return value
  */
-uint8_t bf_value();
+uint64_t bf_value();
 
 /**
  * @brief Get memory value at location.
@@ -39,7 +295,7 @@ uint8_t bf_value();
  * @param location address
  * @return value
  */
-uint8_t bf_value(uint64_t location);
+uint64_t bf_value(uint64_t location);
 
 /**
  * @brief Get pointer offset from current pointer.
@@ -47,15 +303,26 @@ uint8_t bf_value(uint64_t location);
  * @param offset
  * @return new pointer location
  */
-uint64_t bf_ptroffset(int offset);
+uint64_t bf_ptroffset(int64_t offset);
 
 /**
  * @brief Allocate memory for brainfuck program.
+ * Where supported, memory is a ring mapping and size is rounded up to a page
+ * multiple (see bf_memsize).
  * 
- * @param size memory size
+ * @param size memory size in cells (ignored for unbounded memory)
+ * @param type memory mode
+ * @param cell_bits cell width: 8, 16, 32 or 64
  * @return 0 - success; -1 - error
  */
-int bf_malloc(uint64_t size);
+int bf_malloc(uint64_t size, enum bf_memory type = MEMORY_FIXED, int cell_bits = 8);
+
+/**
+ * @brief Select the huge page policy used by bf_malloc.
+ * 
+ * @param policy huge page policy
+ */
+void bf_set_hugepages(enum bf_hugepages policy);
 
 /**
  * @brief Free brainfuck memory.
@@ -69,12 +336,92 @@ void bf_free();
  */
 void bf_reset();
 
+/**
+ * @brief Save memory and pointer location.
+ * Costs as much as the memory touched since the last allocation or reset, not
+ * the memory size. Replaces the previous snapshot.
+ * 
+ * @return 0 - success; -1 - not enough memory to hold it
+ */
+int bf_snapshot();
+
+/**
+ * @brief Return memory and pointer location to the last snapshot.
+ * Can be repeated to run several continuations from the same state.
+ * 
+ * @return 0 - success; -1 - no snapshot
+ */
+int bf_restore();
+
+/**
+ * @brief Select what input reads store at the end of input.
+ * 
+ * @param mode end of input behavior
+ */
+void bf_set_eof(enum bf_eof mode);
+
+/**
+ * @brief Select the engine used by bf_execute.
+ * 
+ * @param type engine
+ */
+void bf_set_engine(enum bf_engine type);
+
 /**
  * @brief Execute brainfuck code.
+ * Program output is buffered and written out before returning.
  * 
  * @param code code stream
  * @return 0 - sucess; -1 - error
  */
 int bf_execute(std::istream &code);
 
+/**
+ * @brief Execute brainfuck code held in memory.
+ * Same as above, without copying the code first.
+ * 
+ * @param code brainfuck code
+ * @return 0 - sucess; -1 - error
+ */
+int bf_execute(std::string_view code);
+
+/**
+ * @brief Read input from a file instead of stdin.
+ * Regular files are mapped whole, so reads never make a system call.
+ * 
+ * @param path file path
+ * @return 0 - success; -1 - error (see errno)
+ */
+int bf_open_input(const char *path);
+
+/**
+ * @brief Release the input file and go back to stdin.
+ * 
+ */
+void bf_close_input();
+
+/**
+ * @brief Write output to a file descriptor instead of stdout.
+ * Output so far is written to the old one first. The descriptor stays open
+ * and owned by the caller.
+ * 
+ * @param fd open file descriptor
+ */
+void bf_set_output(int fd);
+
+/**
+ * @brief Write output from a separate thread.
+ * Filled buffers rotate through a ring of blocks, so a slow reader only holds
+ * up the program once every block is waiting to be written.
+ * 
+ * @return 0 - success; -1 - thread could not be started
+ */
+int bf_start_writer();
+
+/**
+ * @brief Write out all output and stop the writer thread.
+ * 
+ */
+void bf_stop_writer();
+
 #endif // BFI_BF_HPP
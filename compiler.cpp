@@ -0,0 +1,609 @@
+/**
+ * @file compiler.cpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief Brainfuck to bytecode compiler.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#include "compiler.hpp"
+
+#include <map>
+#include <stack>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// brainfuck commands
+#define PTR_INC '>'
+#define PTR_DEC '<'
+#define MEM_INC '+'
+#define MEM_DEC '-'
+#define PUT_CHR '.'
+#define GET_CHR ','
+#define JMP_FWD '['
+#define JMP_BCK ']'
+
+// ADD and SET instructions an ADD or SET looks back over to find its cell
+#define MERGE_WINDOW 64
+
+// loops must stay this close to their entry location to get a direct copy
+#define RANGE_MAX (1 << 20)
+
+// compile time runs use at most this many cells on either side of the start
+#define FOLD_CELLS 4096
+#define FOLD_STEPS (1 << 16)
+
+/**
+ * @brief How loops are copied when specializing.
+ * 
+ */
+enum copy_mode {
+	COPY_PLAIN,		// as they are
+	COPY_GUARDED,	// add a guarded direct copy where the range allows it
+	COPY_DIRECT		// with DIRECT instructions
+};
+
+/**
+ * @brief Memory and output of a program run at compile time.
+ * 
+ */
+struct fold_state {
+	std::vector<uint64_t> cells;	// cells [-FOLD_CELLS, FOLD_CELLS) from the start
+	std::vector<std::pair<uint64_t *, uint64_t>> undo;	// cell and its previous value
+	std::string out;
+	int64_t p;			// pointer, relative to the start
+	uint64_t start;		// starting location
+	uint64_t size;
+	uint64_t mask;		// cell value bits
+	uint64_t steps;
+};
+
+void emit_fold(bf_program &prog, enum bf_op op, int64_t arg, int64_t off);
+void flush_move(bf_program &prog, int64_t &pos);
+int lower_loop(bf_program &prog, uint64_t start, int64_t &pos);
+void specialize(bf_program &prog);
+int loop_range(const std::vector<bf_instr> &code, uint64_t start, int64_t &lo, int64_t &hi);
+void copy_code(const std::vector<bf_instr> &code, uint64_t begin, uint64_t end, enum copy_mode mode, std::vector<bf_instr> &out);
+void copy_loop(const std::vector<bf_instr> &code, uint64_t start, enum copy_mode mode, std::vector<bf_instr> &out);
+uint64_t unit_end(const std::vector<bf_instr> &code, uint64_t start);
+int fold_run(const bf_program &prog, uint64_t begin, uint64_t end, fold_state &st);
+uint64_t *fold_cell(fold_state &st, int64_t offset);
+void fold_set(fold_state &st, uint64_t *cell, uint64_t value);
+void measure(bf_program &prog);
+int64_t wrap(int64_t offset, uint64_t size);
+
+int bf_compile(std::string_view code, bf_program &prog) {
+	std::stack<uint64_t> open;
+	int64_t pos = 0;	// pointer movement not yet emitted
+
+	prog.code.clear();
+
+	for (char c : code) {
+		switch (c) {
+			case PTR_INC:
+				pos++;
+				break;
+			case PTR_DEC:
+				pos--;
+				break;
+			case MEM_INC:
+				emit_fold(prog, OP_ADD, 1, pos);
+				break;
+			case MEM_DEC:
+				emit_fold(prog, OP_ADD, -1, pos);
+				break;
+			case PUT_CHR:
+				prog.code.push_back({ OP_PUT_CHR, 0, pos });
+				break;
+			case GET_CHR:
+				prog.code.push_back({ OP_GET_CHR, 0, pos });
+				break;
+			case JMP_FWD:
+				flush_move(prog, pos);
+				open.push(prog.code.size());
+				prog.code.push_back({ OP_JMP_FWD });
+				break;
+			case JMP_BCK: {
+				if (open.empty()) return -1;
+				flush_move(prog, pos);
+
+				uint64_t start = open.top();
+				open.pop();
+				if (lower_loop(prog, start, pos) == 0) break;
+
+				prog.code[start].jump = prog.code.size();
+				prog.code.push_back({ OP_JMP_BCK });
+				prog.code.back().jump = start;
+				break;
+			}
+		}
+	}
+
+	flush_move(prog, pos);
+	if (!open.empty()) return -1;
+
+	specialize(prog);
+	measure(prog);
+	return 0;
+}
+
+void bf_fold(bf_program &prog, uint64_t ptr, uint64_t size, int cell_bits) {
+	// smaller memories would wrap inside the window
+	if (size < 2 * FOLD_CELLS) return;
+
+	fold_state st;
+	st.cells.assign(2 * FOLD_CELLS, 0);
+	st.p = 0;
+	st.start = ptr;
+	st.size = size;
+	st.mask = (cell_bits == 64) ? UINT64_MAX : (1ULL << cell_bits) - 1;
+	st.steps = 0;
+
+	// run whole top-level units, the first one that cannot finish is undone
+	uint64_t done = 0;
+	while (done < prog.code.size()) {
+		uint64_t end = unit_end(prog.code, done);
+		int64_t p = st.p;
+		uint64_t out_len = st.out.size();
+
+		st.undo.clear();
+		if (fold_run(prog, done, end, st) < 0) {
+			for (auto it = st.undo.rbegin(); it != st.undo.rend(); ++it) *it->first = it->second;
+			st.p = p;
+			st.out.resize(out_len);
+			break;
+		}
+		done = end;
+	}
+	if (done == 0) return;
+
+	std::vector<bf_instr> code;
+	for (uint64_t i = 0; i < st.cells.size(); i++) {
+		if (st.cells[i] != 0) code.push_back({ OP_SET, (int64_t)st.cells[i], (int64_t)i - FOLD_CELLS });
+	}
+	if (!st.out.empty()) {
+		code.push_back({ OP_PUT_STR, (int64_t)st.out.size() });
+		code.back().jump = prog.text.size();
+		prog.text += st.out;
+	}
+	if (st.p != 0) code.push_back({ OP_MOVE, st.p });
+
+	// the rest moves down to follow the new start
+	uint64_t base = code.size();
+	for (uint64_t i = done; i < prog.code.size(); i++) {
+		code.push_back(prog.code[i]);
+		bf_instr &in = code.back();
+		if (in.op == OP_JMP_FWD || in.op == OP_JMP_BCK || in.op == OP_GUARD) {
+			in.jump = in.jump - done + base;
+		}
+	}
+
+	prog.code.swap(code);
+	measure(prog);
+}
+
+void bf_bind(bf_program &prog, uint64_t size) {
+	for (bf_instr &ins : prog.code) {
+		switch (ins.op) {
+			case OP_MOVE:
+				ins.arg = wrap(ins.arg, size);
+				break;
+			case OP_MUL:
+				ins.src = wrap(ins.src, size);
+				ins.off = wrap(ins.off, size);
+				break;
+			case OP_ADD:
+			case OP_SET:
+			case OP_PUT_CHR:
+			case OP_GET_CHR:
+				ins.off = wrap(ins.off, size);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/** Internal Functions **/
+
+/**
+ * @brief Emit an ADD or SET, folding it into an earlier one if possible.
+ * Looks back past up to MERGE_WINDOW ADD and SET instructions on other cells,
+ * since those can be reordered freely.
+ * 
+ * @param prog program being compiled
+ * @param op OP_ADD or OP_SET
+ * @param arg delta or value
+ * @param off cell offset
+ */
+void emit_fold(bf_program &prog, enum bf_op op, int64_t arg, int64_t off) {
+	uint64_t stop = prog.code.size() > MERGE_WINDOW ? prog.code.size() - MERGE_WINDOW : 0;
+	for (uint64_t i = prog.code.size(); i-- > stop;) {
+		bf_instr &last = prog.code[i];
+		if (last.op != OP_ADD && last.op != OP_SET) break;
+		if (last.off != off) continue;
+
+		if (op == OP_SET) {
+			// SET overwrites whatever was done to the cell before it
+			last.op = OP_SET;
+			last.arg = arg;
+		} else {
+			last.arg += arg;
+			if (last.op == OP_ADD && last.arg == 0) {
+				prog.code.erase(prog.code.begin() + i);
+			}
+		}
+		return;
+	}
+
+	prog.code.push_back({ op, arg, off });
+}
+
+/**
+ * @brief Emit pending pointer movement as a single MOVE.
+ * 
+ * @param prog program being compiled
+ * @param pos pending movement, reset to 0
+ */
+void flush_move(bf_program &prog, int64_t &pos) {
+	if (pos != 0) prog.code.push_back({ OP_MOVE, pos });
+	pos = 0;
+}
+
+/**
+ * @brief Replace a recognized loop with equivalent straight-line code.
+ * Handles clear loops ([-], [+], [---]), scan loops ([>], [<<], ...) and
+ * multiply/copy loops ([->+>+++<<]). The latter must be balanced, only contain
+ * ADD and change the loop cell by exactly one per iteration.
+ * 
+ * @param prog program being compiled
+ * @param start location of the open bracket, loop body runs to the end
+ * @param pos pending movement, picks up the MOVE before the loop if absorbed
+ * @return 0 if loop was replaced, -1 otherwise
+ */
+int lower_loop(bf_program &prog, uint64_t start, int64_t &pos) {
+	const bf_instr *body = prog.code.data() + start + 1;
+	uint64_t body_len = prog.code.size() - start - 1;
+
+	if (body_len == 1 && body[0].op == OP_MOVE) {
+		int64_t stride = body[0].arg;
+		prog.code.erase(prog.code.begin() + start, prog.code.end());
+		prog.code.push_back({ OP_SCAN, stride });
+		return 0;
+	}
+
+	std::map<int64_t, int64_t> deltas;
+	for (uint64_t i = 0; i < body_len; i++) {
+		if (body[i].op != OP_ADD) return -1;
+		deltas[body[i].off] += body[i].arg;
+	}
+
+	// any odd step reaches zero eventually, others must be exactly one
+	int64_t step = deltas[0];
+	int clear = 1;
+	for (const auto &[off, delta] : deltas) {
+		if (off != 0 && delta != 0) clear = 0;
+	}
+	if (!(clear && (step & 1)) && step != 1 && step != -1) return -1;
+
+	// the loop does not move, so the movement before it can keep going
+	prog.code.erase(prog.code.begin() + start, prog.code.end());
+	if (!prog.code.empty() && prog.code.back().op == OP_MOVE) {
+		pos = prog.code.back().arg;
+		prog.code.pop_back();
+	}
+
+	// counting up from v to zero takes -v iterations
+	for (const auto &[off, delta] : deltas) {
+		if (off == 0 || delta == 0) continue;
+		prog.code.push_back({ OP_MUL, -step * delta, pos + off });
+		prog.code.back().src = pos;
+	}
+	emit_fold(prog, OP_SET, 0, pos);
+
+	return 0;
+}
+
+/**
+ * @brief Give every outermost loop with a known pointer range a guarded copy.
+ * 
+ * @param prog program being compiled
+ */
+void specialize(bf_program &prog) {
+	std::vector<bf_instr> out;
+	out.reserve(prog.code.size());
+	copy_code(prog.code, 0, prog.code.size(), COPY_GUARDED, out);
+	prog.code.swap(out);
+}
+
+/**
+ * @brief Find the cells a loop can reach, relative to its entry location.
+ * Only balanced loops qualify: every iteration, and every nested loop's
+ * iteration, must return the pointer to where it started, so the range of one
+ * iteration holds for the whole loop.
+ * 
+ * @param code program code
+ * @param start location of the open bracket
+ * @param lo lowest reachable offset (output)
+ * @param hi highest reachable offset (output)
+ * @return 0 - range found; -1 - loop is unbalanced or strays too far
+ */
+int loop_range(const std::vector<bf_instr> &code, uint64_t start, int64_t &lo, int64_t &hi) {
+	int64_t pos = 0;
+	lo = 0;
+	hi = 0;
+
+	for (uint64_t i = start + 1; i < code[start].jump; i++) {
+		const bf_instr &in = code[i];
+		int64_t first = pos + in.off;
+		int64_t last = first;
+
+		switch (in.op) {
+			case OP_MOVE:
+				pos += in.arg;
+				first = pos;
+				last = pos;
+				break;
+			case OP_MUL:
+				if (pos + in.src < first) first = pos + in.src;
+				if (pos + in.src > last) last = pos + in.src;
+				break;
+			case OP_SCAN:
+				return -1;
+			case OP_JMP_FWD: {
+				int64_t inner_lo, inner_hi;
+				if (loop_range(code, i, inner_lo, inner_hi) < 0) return -1;
+				first = pos + inner_lo;
+				last = pos + inner_hi;
+				i = in.jump;
+				break;
+			}
+			default:
+				break;
+		}
+
+		if (first < lo) lo = first;
+		if (last > hi) hi = last;
+		if (lo < -RANGE_MAX || hi > RANGE_MAX) return -1;
+	}
+
+	return (pos == 0) ? 0 : -1;
+}
+
+/**
+ * @brief Copy a range of code, specializing the loops in it.
+ * A guarded loop becomes GUARD, the plain loop and the direct loop. A passing
+ * guard skips the plain loop; after the plain loop the current cell is zero,
+ * so the direct loop is skipped in turn.
+ * 
+ * @param code program code
+ * @param begin first location
+ * @param end location after the last one, not inside a loop
+ * @param mode copy mode
+ * @param out output code
+ */
+void copy_code(const std::vector<bf_instr> &code, uint64_t begin, uint64_t end, enum copy_mode mode, std::vector<bf_instr> &out) {
+	for (uint64_t i = begin; i < end; i++) {
+		const bf_instr &in = code[i];
+		if (in.op == OP_JMP_FWD) {
+			int64_t lo, hi;
+			if (mode == COPY_GUARDED && loop_range(code, i, lo, hi) == 0) {
+				uint64_t guard = out.size();
+				out.push_back({ OP_GUARD, lo, hi });
+				copy_loop(code, i, COPY_PLAIN, out);
+				out[guard].jump = out.size() - 1;
+				copy_loop(code, i, COPY_DIRECT, out);
+			} else {
+				copy_loop(code, i, mode, out);
+			}
+			i = in.jump;
+			continue;
+		}
+
+		out.push_back(in);
+		if (mode != COPY_DIRECT) continue;
+
+		bf_instr &last = out.back();
+		switch (last.op) {
+			case OP_ADD:
+				last.op = OP_ADD_DIRECT;
+				break;
+			case OP_MOVE:
+				last.op = OP_MOVE_DIRECT;
+				break;
+			case OP_SET:
+				last.op = OP_SET_DIRECT;
+				break;
+			case OP_MUL:
+				last.op = OP_MUL_DIRECT;
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/**
+ * @brief Copy a loop, with brackets matched in the output.
+ * 
+ * @param code program code
+ * @param start location of the open bracket
+ * @param mode copy mode for the body
+ * @param out output code
+ */
+void copy_loop(const std::vector<bf_instr> &code, uint64_t start, enum copy_mode mode, std::vector<bf_instr> &out) {
+	uint64_t open = out.size();
+	out.push_back({ OP_JMP_FWD });
+	copy_code(code, start + 1, code[start].jump, mode, out);
+
+	out[open].jump = out.size();
+	out.push_back({ OP_JMP_BCK });
+	out.back().jump = open;
+}
+
+/**
+ * @brief Find the end of a top-level unit: an instruction, a loop, or a guard
+ * together with both copies of its loop.
+ * 
+ * @param code program code
+ * @param start first location of the unit
+ * @return location after the unit
+ */
+uint64_t unit_end(const std::vector<bf_instr> &code, uint64_t start) {
+	switch (code[start].op) {
+		case OP_JMP_FWD:
+			return code[start].jump + 1;
+		case OP_GUARD:
+			return code[code[start].jump + 1].jump + 1;
+		default:
+			return start + 1;
+	}
+}
+
+/**
+ * @brief Run part of a program at compile time.
+ * DIRECT instructions behave like the regular ones, since their guard already
+ * ruled out wrapping.
+ * 
+ * @param prog program being folded
+ * @param begin first location
+ * @param end location after the last one, not inside a loop
+ * @param st memory and output, changed cells are recorded for undoing
+ * @return 0 - success; -1 - reads input or runs out of steps
+ */
+int fold_run(const bf_program &prog, uint64_t begin, uint64_t end, fold_state &st) {
+	for (uint64_t pc = begin; pc < end; pc++) {
+		if (++st.steps > FOLD_STEPS) return -1;
+
+		const bf_instr &in = prog.code[pc];
+		uint64_t *cell;
+		switch (in.op) {
+			case OP_ADD:
+			case OP_ADD_DIRECT:
+				if ((cell = fold_cell(st, in.off)) == NULL) return -1;
+				fold_set(st, cell, *cell + in.arg);
+				break;
+			case OP_MOVE:
+			case OP_MOVE_DIRECT:
+				st.p += in.arg;
+				if (fold_cell(st, 0) == NULL) return -1;
+				break;
+			case OP_SET:
+			case OP_SET_DIRECT:
+				if ((cell = fold_cell(st, in.off)) == NULL) return -1;
+				fold_set(st, cell, in.arg);
+				break;
+			case OP_MUL:
+			case OP_MUL_DIRECT: {
+				uint64_t *src = fold_cell(st, in.src);
+				if ((cell = fold_cell(st, in.off)) == NULL || src == NULL) return -1;
+				fold_set(st, cell, *cell + (uint64_t)in.arg * *src);
+				break;
+			}
+			case OP_SCAN:
+				while (1) {
+					if ((cell = fold_cell(st, 0)) == NULL) return -1;
+					if (*cell == 0) break;
+					if (++st.steps > FOLD_STEPS) return -1;
+					st.p += in.arg;
+				}
+				break;
+			case OP_PUT_CHR:
+				if ((cell = fold_cell(st, in.off)) == NULL) return -1;
+				st.out.push_back((char)*cell);
+				break;
+			case OP_GET_CHR:
+				return -1;
+			case OP_JMP_FWD:
+				if (*fold_cell(st, 0) == 0) pc = in.jump;
+				break;
+			case OP_JMP_BCK:
+				if (*fold_cell(st, 0) != 0) pc = in.jump;
+				break;
+			case OP_GUARD: {
+				// the pointer stays in the window, so it never wraps more than once
+				int64_t p = (int64_t)st.start + st.p;
+				uint64_t location = (p < 0) ? p + st.size : ((uint64_t)p >= st.size) ? p - st.size : p;
+				if (location + in.arg < st.size && location + in.off < st.size) pc = in.jump;
+				break;
+			}
+			case OP_PUT_STR:
+				st.out.append(prog.text, in.jump, in.arg);
+				break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Find a cell of a program run at compile time.
+ * 
+ * @param st memory
+ * @param offset cell offset from the pointer
+ * @return cell; NULL if it is outside the window
+ */
+uint64_t *fold_cell(fold_state &st, int64_t offset) {
+	int64_t i = st.p + offset + FOLD_CELLS;
+	if (i < 0 || i >= 2 * FOLD_CELLS) return NULL;
+	return &st.cells[i];
+}
+
+/**
+ * @brief Write a cell of a program run at compile time.
+ * 
+ * @param st memory
+ * @param cell cell in the window
+ * @param value value, truncated to the cell width
+ */
+void fold_set(fold_state &st, uint64_t *cell, uint64_t value) {
+	st.undo.push_back({ cell, *cell });
+	*cell = value & st.mask;
+}
+
+/**
+ * @brief Record the range of cell offsets written by a program.
+ * Always includes offset 0, so the window covers the cells the pointer itself
+ * rests on.
+ * 
+ * @param prog compiled program
+ */
+void measure(bf_program &prog) {
+	prog.min_off = 0;
+	prog.max_off = 0;
+
+	for (const bf_instr &ins : prog.code) {
+		switch (ins.op) {
+			case OP_ADD:
+			case OP_SET:
+			case OP_MUL:
+			case OP_GET_CHR:
+			case OP_ADD_DIRECT:
+			case OP_SET_DIRECT:
+			case OP_MUL_DIRECT:
+				if (ins.off < prog.min_off) prog.min_off = ins.off;
+				if (ins.off > prog.max_off) prog.max_off = ins.off;
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/**
+ * @brief Reduce an offset to [0, size).
+ * 
+ * @param offset signed offset
+ * @param size memory size
+ * @return equivalent non-negative offset
+ */
+int64_t wrap(int64_t offset, uint64_t size) {
+	uint64_t offset_abs = (offset < 0) ? -(uint64_t)offset : offset;
+	offset_abs %= size;
+
+	if (offset < 0 && offset_abs != 0) return size - offset_abs;
+	return offset_abs;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file compiler.hpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief Brainfuck to bytecode compiler.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef BFI_COMPILER_HPP
+#define BFI_COMPILER_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @brief Bytecode operations.
+ * 
+ */
+enum bf_op : uint8_t {
+	OP_ADD,
+	OP_MOVE,
+	OP_SET,
+	OP_MUL,
+	OP_SCAN,
+	OP_PUT_CHR,
+	OP_GET_CHR,
+	OP_JMP_FWD,
+	OP_JMP_BCK,
+	OP_GUARD,
+	OP_ADD_DIRECT,
+	OP_MOVE_DIRECT,
+	OP_SET_DIRECT,
+	OP_MUL_DIRECT,
+	OP_PUT_STR
+};
+
+/**
+ * @brief Single bytecode instruction.
+ * arg is the value delta (ADD), pointer offset (MOVE), value (SET),
+ * factor (MUL), stride (SCAN) or length (PUT_STR).
+ * Cells are addressed relative to the pointer, which only moves on MOVE and
+ * SCAN instructions.
+ * GUARD checks that cells arg to off around the pointer lie inside memory
+ * without wrapping, and if so jumps to a copy of the following loop made of
+ * DIRECT instructions, whose offsets and distances are used as is.
+ * PUT_STR prints arg bytes of the program's literal text, starting at jump.
+ * 
+ */
+struct bf_instr {
+	enum bf_op op;
+	int64_t arg;	// operand
+	int64_t off;	// cell offset from pointer
+	union {
+		uint64_t jump;	// matching bracket location, or text location (PUT_STR)
+		int64_t src;	// source cell offset (MUL)
+	};
+
+	bf_instr(enum bf_op op, int64_t arg = 0, int64_t off = 0)
+		: op(op), arg(arg), off(off), jump(0) {}
+};
+
+/**
+ * @brief Compiled brainfuck program.
+ * 
+ */
+struct bf_program {
+	std::vector<bf_instr> code;
+	std::string text;	// literal output (PUT_STR)
+	int64_t min_off = 0;	// lowest cell offset written (before binding)
+	int64_t max_off = 0;	// highest cell offset written (before binding)
+};
+
+/**
+ * @brief Runtime functions called from natively compiled code.
+ * ctx is the value passed to the compiled function. get_chr takes the current
+ * cell value and returns the new one.
+ * 
+ */
+struct bf_runtime {
+	void (*put_chr)(void *ctx, uint64_t value);
+	uint64_t (*get_chr)(void *ctx, uint64_t value);
+	uint64_t (*scan)(void *ctx, uint64_t location, int64_t stride);
+	void (*put_str)(void *ctx, const char *data, uint64_t length);
+};
+
+/**
+ * @brief Compile brainfuck code into bytecode.
+ * Loops that provably keep the pointer within a small window around their
+ * entry location get a guarded copy that runs without wrapping locations.
+ * Also records the range of offsets the program writes to, so that together
+ * with the pointer locations reached after each MOVE and SCAN it bounds the
+ * memory a run touches.
+ * 
+ * @param code brainfuck code
+ * @param prog output program
+ * @return 0 - success; -1 - unmatched brackets
+ */
+int bf_compile(std::string_view code, bf_program &prog);
+
+/**
+ * @brief Run the start of a program at compile time.
+ * Only valid while all memory is zero. Top-level instructions and loops are
+ * evaluated until the first input read or a step limit, and replaced by SETs
+ * of the cells they leave nonzero, a single PUT_STR of everything they print
+ * and a MOVE to where they leave the pointer.
+ * 
+ * @param prog compiled (unbound) program
+ * @param ptr starting pointer location
+ * @param size memory size
+ * @param cell_bits cell width
+ */
+void bf_fold(bf_program &prog, uint64_t ptr, uint64_t size, int cell_bits);
+
+/**
+ * @brief Bind program to a memory size.
+ * Reduces all cell offsets and MOVE distances to [0, size), so that wrapping
+ * a location takes at most one subtraction. GUARD and DIRECT instructions are
+ * left alone.
+ * 
+ * @param prog compiled program
+ * @param size memory size
+ */
+void bf_bind(bf_program &prog, uint64_t size);
+
+#endif // BFI_COMPILER_HPP
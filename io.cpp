@@ -0,0 +1,319 @@
+/**
+ * @file io.cpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief Buffered brainfuck input and output.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#include "io.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void write_all(int fd, const uint8_t *data, size_t len);
+void *writer_main(void *arg);
+template <typename Ready> void wait_until(bf_io &io, std::atomic<bool> &idle, pthread_cond_t &cond, Ready ready);
+void wake(bf_io &io, std::atomic<bool> &idle, pthread_cond_t &cond);
+void free_ring(bf_io &io);
+
+void bf_out_put(bf_io &io, uint8_t chr) {
+	io.out_buf[io.out_len++] = chr;
+	if (io.out_len == OUT_BUF_SIZE) {
+		bf_out_flush(io);
+		return;
+	}
+
+	if (chr != '\n') return;
+	if (io.out_tty < 0) io.out_tty = isatty(io.out_fd);
+	if (io.out_tty) bf_out_flush(io);
+}
+
+void bf_out_write(bf_io &io, const char *data, uint64_t length) {
+	// the buffer is never left full, bf_out_put relies on that
+	if (length >= OUT_BUF_SIZE - io.out_len) {
+		bf_out_flush(io);
+		if (length >= OUT_BUF_SIZE && io.ring == NULL) {
+			write_all(io.out_fd, (const uint8_t *)data, length);
+			return;
+		}
+
+		// only the writer thread may write, so large writes go through the ring
+		while (length >= OUT_BUF_SIZE) {
+			std::memcpy(io.out_buf, data, OUT_BUF_SIZE);
+			io.out_len = OUT_BUF_SIZE;
+			bf_out_flush(io);
+			data += OUT_BUF_SIZE;
+			length -= OUT_BUF_SIZE;
+		}
+	}
+
+	std::memcpy(io.out_buf + io.out_len, data, length);
+	io.out_len += length;
+
+	if (io.out_tty < 0) io.out_tty = isatty(io.out_fd);
+	if (io.out_tty && std::memchr(data, '\n', length) != NULL) bf_out_flush(io);
+}
+
+void bf_out_flush(bf_io &io) {
+	if (io.out_len == 0) return;
+	if (io.ring == NULL) {
+		write_all(io.out_fd, io.out_buf, io.out_len);
+		io.out_len = 0;
+		return;
+	}
+
+	// hand the block over, then wait for a free one if all are in flight
+	uint64_t put = io.ring_put.load(std::memory_order_relaxed);
+	io.ring[put % OUT_BLOCKS].len = io.out_len;
+	io.ring_put.store(++put);
+	wake(io, io.writer_idle, io.ring_filled);
+	wait_until(io, io.filler_idle, io.ring_drained, [&io, put] {
+		return put - io.ring_get.load() < OUT_BLOCKS;
+	});
+
+	io.out_buf = io.ring[put % OUT_BLOCKS].data;
+	io.out_len = 0;
+}
+
+void bf_out_drain(bf_io &io) {
+	bf_out_flush(io);
+	if (io.ring == NULL) return;
+
+	uint64_t put = io.ring_put.load(std::memory_order_relaxed);
+	wait_until(io, io.filler_idle, io.ring_drained, [&io, put] {
+		return io.ring_get.load() == put;
+	});
+}
+
+void bf_out_set_fd(bf_io &io, int fd) {
+	// the writer thread only reads out_fd while it has blocks to write
+	bf_out_drain(io);
+	io.out_fd = fd;
+	io.out_tty = -1;
+}
+
+int bf_out_start_writer(bf_io &io) {
+	if (io.ring != NULL) return 0;
+
+	bf_out_flush(io);
+	if (pthread_mutex_init(&io.ring_lock, NULL) != 0) return -1;
+	if (pthread_cond_init(&io.ring_filled, NULL) != 0) {
+		pthread_mutex_destroy(&io.ring_lock);
+		return -1;
+	}
+	if (pthread_cond_init(&io.ring_drained, NULL) != 0) {
+		pthread_cond_destroy(&io.ring_filled);
+		pthread_mutex_destroy(&io.ring_lock);
+		return -1;
+	}
+
+	io.ring = new (std::nothrow) out_block[OUT_BLOCKS];
+	io.ring_put = 0;
+	io.ring_get = 0;
+	io.writer_stop = false;
+	io.writer_idle = false;
+	io.filler_idle = false;
+	if (io.ring == NULL || pthread_create(&io.writer, NULL, writer_main, &io) != 0) {
+		free_ring(io);
+		return -1;
+	}
+
+	io.out_buf = io.ring[0].data;
+	return 0;
+}
+
+void bf_out_stop_writer(bf_io &io) {
+	if (io.ring == NULL) return;
+
+	bf_out_drain(io);
+	io.writer_stop = true;
+	wake(io, io.writer_idle, io.ring_filled);
+	pthread_join(io.writer, NULL);
+
+	free_ring(io);
+	io.out_buf = io.out_direct;
+}
+
+int bf_in_get(bf_io &io) {
+	if (io.in_pos < io.in_len) return io.in_data[io.in_pos++];
+	if (io.in_mapped) return -1;
+
+	// the program may be waiting on a prompt it printed
+	if (io.in_tty < 0) io.in_tty = isatty(io.in_fd);
+	if (io.in_tty) bf_out_drain(io);
+	else bf_out_flush(io);
+
+	ssize_t got;
+	do {
+		got = read(io.in_fd, io.in_buf, IN_BUF_SIZE);
+	} while (got < 0 && errno == EINTR);
+	if (got <= 0) return -1;
+
+	io.in_pos = 1;
+	io.in_len = got;
+	return io.in_buf[0];
+}
+
+int bf_in_open(bf_io &io, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	bf_in_close(io);
+	if (!S_ISREG(st.st_mode)) {
+		io.in_fd = fd;
+		return 0;
+	}
+
+	// an empty file cannot be mapped, but there is nothing to read anyway
+	if (st.st_size > 0) {
+		void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping == MAP_FAILED) {
+			int err = errno;
+			close(fd);
+			errno = err;
+			return -1;
+		}
+		madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+		io.in_data = (const uint8_t *)mapping;
+		io.in_len = st.st_size;
+	}
+	close(fd);
+	io.in_mapped = true;
+	return 0;
+}
+
+void bf_in_close(bf_io &io) {
+	if (io.in_mapped && io.in_len > 0) munmap((void *)io.in_data, io.in_len);
+	if (io.in_fd != STDIN_FILENO) close(io.in_fd);
+
+	io.in_data = io.in_buf;
+	io.in_pos = 0;
+	io.in_len = 0;
+	io.in_fd = STDIN_FILENO;
+	io.in_mapped = false;
+	io.in_tty = -1;
+}
+
+/** Internal Functions **/
+
+/**
+ * @brief Write a whole buffer, retrying short and interrupted writes.
+ * Gives up on any other error, like the stream it replaces.
+ * 
+ * @param fd file descriptor
+ * @param data bytes
+ * @param len number of bytes
+ */
+void write_all(int fd, const uint8_t *data, size_t len) {
+	while (len > 0) {
+		ssize_t done = write(fd, data, len);
+		if (done < 0) {
+			if (errno == EINTR) continue;
+			return;
+		}
+
+		data += done;
+		len -= done;
+	}
+}
+
+/**
+ * @brief Writer thread: write blocks in order until stopped.
+ * 
+ * @param arg endpoints (bf_io)
+ * @return NULL
+ */
+void *writer_main(void *arg) {
+	bf_io &io = *(bf_io *)arg;
+
+	while (1) {
+		uint64_t get = io.ring_get.load(std::memory_order_relaxed);
+		wait_until(io, io.writer_idle, io.ring_filled, [&io, get] {
+			return io.ring_put.load() != get || io.writer_stop.load();
+		});
+		// stopping only happens once everything is written
+		if (io.ring_put.load() == get) break;
+
+		out_block &block = io.ring[get % OUT_BLOCKS];
+		write_all(io.out_fd, block.data, block.len);
+		io.ring_get.store(get + 1);
+		wake(io, io.filler_idle, io.ring_drained);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Sleep until a condition holds.
+ * The other side checks idle after each update and only then takes the lock
+ * to signal, so neither side locks while the ring keeps moving. The updates,
+ * the condition and idle use sequentially consistent accesses: either the
+ * condition sees the update or the other side sees idle.
+ * 
+ * @tparam Ready condition type
+ * @param io endpoints
+ * @param idle flag telling the other side to signal
+ * @param cond condition variable signalled by the other side
+ * @param ready condition
+ */
+template <typename Ready>
+void wait_until(bf_io &io, std::atomic<bool> &idle, pthread_cond_t &cond, Ready ready) {
+	if (ready()) return;
+
+	pthread_mutex_lock(&io.ring_lock);
+	idle = true;
+	while (!ready()) {
+		if (pthread_cond_wait(&cond, &io.ring_lock) != 0) {
+			// should not happen, but polling still makes progress
+			pthread_mutex_unlock(&io.ring_lock);
+			usleep(1000);
+			pthread_mutex_lock(&io.ring_lock);
+		}
+	}
+	idle = false;
+	pthread_mutex_unlock(&io.ring_lock);
+}
+
+/**
+ * @brief Wake the other side if it is sleeping in wait_until.
+ * 
+ * @param io endpoints
+ * @param idle flag set by the sleeping side
+ * @param cond condition variable it sleeps on
+ */
+void wake(bf_io &io, std::atomic<bool> &idle, pthread_cond_t &cond) {
+	if (!idle) return;
+
+	pthread_mutex_lock(&io.ring_lock);
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&io.ring_lock);
+}
+
+/**
+ * @brief Release the ring and its synchronization objects.
+ * 
+ * @param io endpoints
+ */
+void free_ring(bf_io &io) {
+	pthread_cond_destroy(&io.ring_drained);
+	pthread_cond_destroy(&io.ring_filled);
+	pthread_mutex_destroy(&io.ring_lock);
+	delete[] io.ring;
+	io.ring = NULL;
+}
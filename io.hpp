@@ -0,0 +1,164 @@
+/**
+ * @file io.hpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief Buffered brainfuck input and output.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef BFI_IO_HPP
+#define BFI_IO_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+#include <unistd.h>
+
+#define OUT_BUF_SIZE (64 * 1024)
+#define OUT_BLOCKS 8
+#define IN_BUF_SIZE (64 * 1024)
+
+/**
+ * @brief Output block handed to the writer thread.
+ * 
+ */
+struct out_block {
+	uint8_t data[OUT_BUF_SIZE];
+	size_t len;
+};
+
+/**
+ * @brief Input and output endpoints of one machine.
+ * Not copyable, the output buffer pointer refers into the struct itself.
+ * 
+ */
+struct bf_io {
+	// output buffer, one of the ring blocks while the writer thread runs
+	uint8_t out_direct[OUT_BUF_SIZE];
+	uint8_t *out_buf = out_direct;
+	size_t out_len = 0;
+	int out_fd = STDOUT_FILENO;
+	int out_tty = -1;	// out_fd is a terminal, -1 until checked
+
+	// writer thread: a ring of blocks, each side only advances its own count,
+	// block ring_put % OUT_BLOCKS is being filled
+	out_block *ring = NULL;
+	std::atomic<uint64_t> ring_put{0};	// blocks handed over (interpreter)
+	std::atomic<uint64_t> ring_get{0};	// blocks written (writer)
+	std::atomic<bool> writer_stop{false};
+
+	// sleeping while the ring is empty or full, never taken otherwise
+	std::atomic<bool> writer_idle{false};	// writer waits for ring_filled
+	std::atomic<bool> filler_idle{false};	// interpreter waits for ring_drained
+	pthread_mutex_t ring_lock;
+	pthread_cond_t ring_filled;
+	pthread_cond_t ring_drained;
+	pthread_t writer;
+
+	// input, bytes [in_pos, in_len) of in_data not yet read
+	uint8_t in_buf[IN_BUF_SIZE];
+	const uint8_t *in_data = in_buf;
+	size_t in_pos = 0;
+	size_t in_len = 0;
+	int in_fd = STDIN_FILENO;
+	bool in_mapped = false;	// in_data holds the whole input file
+	int in_tty = -1;	// in_fd is a terminal, -1 until checked
+
+	bf_io() = default;
+	bf_io(const bf_io &) = delete;
+	bf_io &operator=(const bf_io &) = delete;
+};
+
+/**
+ * @brief Append a byte to the output buffer.
+ * The buffer is written out when full, and on newline if the output is a
+ * terminal.
+ * 
+ * @param io endpoints
+ * @param chr byte
+ */
+void bf_out_put(bf_io &io, uint8_t chr);
+
+/**
+ * @brief Append bytes to the output buffer.
+ * Large writes skip the buffer and go out in a single write.
+ * 
+ * @param io endpoints
+ * @param data bytes
+ * @param length number of bytes
+ */
+void bf_out_write(bf_io &io, const char *data, uint64_t length);
+
+/**
+ * @brief Write out the output buffer.
+ * With the writer thread running, the buffer is only handed over to it.
+ * 
+ * @param io endpoints
+ */
+void bf_out_flush(bf_io &io);
+
+/**
+ * @brief Write out the output buffer and wait until all output is written.
+ * 
+ * @param io endpoints
+ */
+void bf_out_drain(bf_io &io);
+
+/**
+ * @brief Write output to another file descriptor.
+ * Output so far is written to the old one first. The descriptor is not
+ * closed when replaced.
+ * 
+ * @param io endpoints
+ * @param fd open file descriptor
+ */
+void bf_out_set_fd(bf_io &io, int fd);
+
+/**
+ * @brief Write output from a separate thread.
+ * Filled buffers rotate through a ring of blocks, so a slow reader only holds
+ * up the program once every block is waiting to be written.
+ * 
+ * @param io endpoints
+ * @return 0 - success; -1 - thread could not be started
+ */
+int bf_out_start_writer(bf_io &io);
+
+/**
+ * @brief Write out all output and stop the writer thread.
+ * 
+ * @param io endpoints
+ */
+void bf_out_stop_writer(bf_io &io);
+
+/**
+ * @brief Read a byte of input.
+ * Input is read in large blocks and delivered verbatim. Pending output is
+ * written out before any read that may block, and waited for if the input is
+ * a terminal.
+ * 
+ * @param io endpoints
+ * @return byte; -1 - end of input or error
+ */
+int bf_in_get(bf_io &io);
+
+/**
+ * @brief Read input from a file instead of the current input.
+ * Regular files are mapped whole, so reads never make a system call.
+ * 
+ * @param io endpoints
+ * @param path file path
+ * @return 0 - success; -1 - error (see errno)
+ */
+int bf_in_open(bf_io &io, const char *path);
+
+/**
+ * @brief Release the input file and go back to standard input.
+ * 
+ * @param io endpoints
+ */
+void bf_in_close(bf_io &io);
+
+#endif // BFI_IO_HPP
@@ -0,0 +1,385 @@
+/**
+ * @file jit.cpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief x86-64 JIT compiler for brainfuck bytecode.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#include "jit.hpp"
+
+#include <cstring>
+#include <initializer_list>
+#include <stack>
+#include <vector>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Register usage in generated code:
+ *   rbx - memory base
+ *   r12 - pointer location
+ *   r13 - memory size
+ *   r14 - runtime context
+ *   r15 - lowest pointer location (rotated, see bf_jit_fn)
+ *   rbp - highest pointer location (rotated)
+ *   rax, rcx, rdx - scratch
+ *   [rsp] - bounds
+ */
+
+// index register for cell operands
+#define IDX_RAX 0
+#define IDX_R12 1
+
+// x86 registers (low 3 bits)
+#define REG_RCX 1
+#define REG_RSI 6
+
+typedef std::vector<uint8_t> code_buf;
+
+/**
+ * @brief Cell memory operand: [rbx + index + disp].
+ * 
+ */
+struct cell_ref {
+	int idx;
+	int32_t disp;
+};
+
+void emit(code_buf &buf, std::initializer_list<uint8_t> bytes);
+void emit_u32(code_buf &buf, uint32_t value);
+void emit_u64(code_buf &buf, uint64_t value);
+void emit_wrap(code_buf &buf, int64_t offset);
+cell_ref emit_addr(code_buf &buf, int64_t offset, bool ring);
+void emit_cell(code_buf &buf, uint8_t rex, std::initializer_list<uint8_t> opcode, uint8_t reg, cell_ref ref);
+void emit_call(code_buf &buf, const void *fn);
+void emit_track(code_buf &buf, int32_t offset);
+void patch_u32(code_buf &buf, size_t pos, uint32_t value);
+
+int bf_jit_compile(const bf_program &prog, const bf_runtime &rt, bool ring, bf_jit_code &code) {
+#if defined(__x86_64__)
+	code_buf buf;
+	std::stack<size_t> loops;	// location after each open bracket's jump
+	std::vector<size_t> starts;	// location of each instruction's code
+	std::vector<std::pair<size_t, uint64_t>> guards;	// jump to patch, target instruction
+
+	// push rbp, rbx, r12, r13, r14, r15, r8 (keeps the stack 16-byte aligned)
+	emit(buf, { 0x55, 0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57, 0x41, 0x50 });
+	// mov rbx, rdi; mov r12, rsi; mov r13, rdx; mov r14, rcx
+	emit(buf, { 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x49, 0x89, 0xD5, 0x49, 0x89, 0xCE });
+	// mov r15, [r8]; mov rbp, [r8 + 8]
+	emit(buf, { 0x4D, 0x8B, 0x38, 0x49, 0x8B, 0x68, 0x08 });
+
+	const cell_ref current = { IDX_R12, 0 };
+
+	for (const bf_instr &in : prog.code) {
+		cell_ref ref;
+		starts.push_back(buf.size());
+		switch (in.op) {
+			case OP_ADD:
+				// add byte [cell], imm8
+				ref = emit_addr(buf, in.off, ring);
+				emit_cell(buf, 0, { 0x80 }, 0, ref);
+				emit(buf, { (uint8_t)in.arg });
+				break;
+			case OP_MOVE:
+				// mov r12, rax
+				emit_wrap(buf, in.arg);
+				emit(buf, { 0x49, 0x89, 0xC4 });
+				emit_track(buf, 0);
+				break;
+			case OP_SET:
+				// mov byte [cell], imm8
+				ref = emit_addr(buf, in.off, ring);
+				emit_cell(buf, 0, { 0xC6 }, 0, ref);
+				emit(buf, { (uint8_t)in.arg });
+				break;
+			case OP_MUL:
+				// movzx ecx, byte [src]; imul ecx, ecx, imm32; add byte [cell], cl
+				ref = emit_addr(buf, in.src, ring);
+				emit_cell(buf, 0, { 0x0F, 0xB6 }, REG_RCX, ref);
+				emit(buf, { 0x69, 0xC9 });
+				emit_u32(buf, (uint32_t)in.arg);
+				ref = emit_addr(buf, in.off, ring);
+				emit_cell(buf, 0, { 0x00 }, REG_RCX, ref);
+				break;
+			case OP_SCAN:
+				// mov rdi, r14; mov rsi, r12; mov rdx, imm64; call; mov r12, rax
+				emit(buf, { 0x4C, 0x89, 0xF7, 0x4C, 0x89, 0xE6, 0x48, 0xBA });
+				emit_u64(buf, (uint64_t)in.arg);
+				emit_call(buf, (const void *)rt.scan);
+				emit(buf, { 0x49, 0x89, 0xC4 });
+				emit_track(buf, 0);
+				break;
+			case OP_PUT_CHR:
+				// movzx esi, byte [cell]; mov rdi, r14; call
+				ref = emit_addr(buf, in.off, ring);
+				emit_cell(buf, 0, { 0x0F, 0xB6 }, REG_RSI, ref);
+				emit(buf, { 0x4C, 0x89, 0xF7 });
+				emit_call(buf, (const void *)rt.put_chr);
+				break;
+			case OP_GET_CHR:
+				// movzx esi, byte [cell]; mov rdi, r14; call; mov ecx, eax; mov byte [cell], cl
+				ref = emit_addr(buf, in.off, ring);
+				emit_cell(buf, 0, { 0x0F, 0xB6 }, REG_RSI, ref);
+				emit(buf, { 0x4C, 0x89, 0xF7 });
+				emit_call(buf, (const void *)rt.get_chr);
+				emit(buf, { 0x89, 0xC1 });
+				ref = emit_addr(buf, in.off, ring);
+				emit_cell(buf, 0, { 0x88 }, REG_RCX, ref);
+				break;
+			case OP_JMP_FWD:
+				// cmp byte [r12 cell], 0; je rel32 (patched at the closed bracket)
+				emit_cell(buf, 0, { 0x80 }, 7, current);
+				emit(buf, { 0x00, 0x0F, 0x84 });
+				emit_u32(buf, 0);
+				loops.push(buf.size());
+				break;
+			case OP_JMP_BCK: {
+				// cmp byte [r12 cell], 0; jne rel32
+				size_t body = loops.top();
+				loops.pop();
+				emit_cell(buf, 0, { 0x80 }, 7, current);
+				emit(buf, { 0x00, 0x0F, 0x85 });
+				emit_u32(buf, (uint32_t)(body - (buf.size() + 4)));
+				patch_u32(buf, body - 4, (uint32_t)(buf.size() - body));
+				break;
+			}
+			case OP_GUARD: {
+				// lea rax, [r12 + lo]; cmp rax, r13; jae skip
+				// lea rdx, [r12 + hi]; cmp rdx, r13; jae skip
+				emit(buf, { 0x49, 0x8D, 0x84, 0x24 });
+				emit_u32(buf, (uint32_t)in.arg);
+				emit(buf, { 0x4C, 0x39, 0xE8, 0x0F, 0x83 });
+				emit_u32(buf, 0);
+				size_t skip_lo = buf.size();
+				emit(buf, { 0x49, 0x8D, 0x94, 0x24 });
+				emit_u32(buf, (uint32_t)in.off);
+				emit(buf, { 0x4C, 0x39, 0xEA, 0x0F, 0x83 });
+				emit_u32(buf, 0);
+				size_t skip_hi = buf.size();
+				emit_track(buf, (int32_t)in.arg);
+				emit_track(buf, (int32_t)in.off);
+				// jmp rel32 (patched once the direct loop is emitted)
+				emit(buf, { 0xE9 });
+				emit_u32(buf, 0);
+				guards.push_back({ buf.size(), in.jump + 1 });
+				patch_u32(buf, skip_lo - 4, (uint32_t)(buf.size() - skip_lo));
+				patch_u32(buf, skip_hi - 4, (uint32_t)(buf.size() - skip_hi));
+				break;
+			}
+			case OP_ADD_DIRECT:
+				// add byte [r12 cell], imm8
+				emit_cell(buf, 0, { 0x80 }, 0, emit_addr(buf, in.off, true));
+				emit(buf, { (uint8_t)in.arg });
+				break;
+			case OP_MOVE_DIRECT:
+				// add r12, imm32
+				emit(buf, { 0x49, 0x81, 0xC4 });
+				emit_u32(buf, (uint32_t)in.arg);
+				break;
+			case OP_SET_DIRECT:
+				// mov byte [r12 cell], imm8
+				emit_cell(buf, 0, { 0xC6 }, 0, emit_addr(buf, in.off, true));
+				emit(buf, { (uint8_t)in.arg });
+				break;
+			case OP_MUL_DIRECT:
+				// movzx ecx, byte [r12 src]; imul ecx, ecx, imm32; add byte [r12 cell], cl
+				emit_cell(buf, 0, { 0x0F, 0xB6 }, REG_RCX, emit_addr(buf, in.src, true));
+				emit(buf, { 0x69, 0xC9 });
+				emit_u32(buf, (uint32_t)in.arg);
+				emit_cell(buf, 0, { 0x00 }, REG_RCX, emit_addr(buf, in.off, true));
+				break;
+			case OP_PUT_STR:
+				// mov rdi, r14; mov rsi, imm64; mov rdx, imm64; call
+				emit(buf, { 0x4C, 0x89, 0xF7, 0x48, 0xBE });
+				emit_u64(buf, (uint64_t)(prog.text.data() + in.jump));
+				emit(buf, { 0x48, 0xBA });
+				emit_u64(buf, (uint64_t)in.arg);
+				emit_call(buf, (const void *)rt.put_str);
+				break;
+		}
+	}
+
+	for (const auto &[end, target] : guards) {
+		patch_u32(buf, end - 4, (uint32_t)(starts[target] - end));
+	}
+
+	// pop rcx; mov [rcx], r15; mov [rcx + 8], rbp
+	emit(buf, { 0x59, 0x4C, 0x89, 0x39, 0x48, 0x89, 0x69, 0x08 });
+	// mov rax, r12; pop r15, r14, r13, r12, rbx, rbp; ret
+	emit(buf, { 0x4C, 0x89, 0xE0 });
+	emit(buf, { 0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0x5D, 0xC3 });
+
+	// map writable, copy, then flip to executable
+	long page = sysconf(_SC_PAGESIZE);
+	size_t size = (buf.size() + page - 1) / page * page;
+	void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) return -1;
+
+	std::memcpy(mapping, buf.data(), buf.size());
+	if (mprotect(mapping, size, PROT_READ | PROT_EXEC) < 0) {
+		munmap(mapping, size);
+		return -1;
+	}
+
+	code.fn = (bf_jit_fn)mapping;
+	code.buf = mapping;
+	code.size = size;
+	return 0;
+#else
+	(void)prog;
+	(void)rt;
+	(void)ring;
+	(void)code;
+	return -1;
+#endif
+}
+
+void bf_jit_free(bf_jit_code &code) {
+	if (code.buf) munmap(code.buf, code.size);
+	code.buf = NULL;
+	code.fn = NULL;
+}
+
+/** Internal Functions **/
+
+/**
+ * @brief Append raw bytes.
+ * 
+ * @param buf code buffer
+ * @param bytes bytes to append
+ */
+void emit(code_buf &buf, std::initializer_list<uint8_t> bytes) {
+	buf.insert(buf.end(), bytes);
+}
+
+/**
+ * @brief Append a little-endian 32-bit value.
+ * 
+ * @param buf code buffer
+ * @param value value
+ */
+void emit_u32(code_buf &buf, uint32_t value) {
+	for (int i = 0; i < 4; i++) buf.push_back(value >> (i * 8));
+}
+
+/**
+ * @brief Append a little-endian 64-bit value.
+ * 
+ * @param buf code buffer
+ * @param value value
+ */
+void emit_u64(code_buf &buf, uint64_t value) {
+	for (int i = 0; i < 8; i++) buf.push_back(value >> (i * 8));
+}
+
+/**
+ * @brief Compute r12 + offset wrapped to the memory size into rax.
+ * 
+ * @param buf code buffer
+ * @param offset bound offset in [0, memsize)
+ */
+void emit_wrap(code_buf &buf, int64_t offset) {
+	if (offset <= INT32_MAX) {
+		// lea rax, [r12 + disp32]
+		emit(buf, { 0x49, 0x8D, 0x84, 0x24 });
+		emit_u32(buf, (uint32_t)offset);
+	} else {
+		// mov rax, imm64; add rax, r12
+		emit(buf, { 0x48, 0xB8 });
+		emit_u64(buf, (uint64_t)offset);
+		emit(buf, { 0x4C, 0x01, 0xE0 });
+	}
+
+	// mov rdx, rax; sub rdx, r13; cmovae rax, rdx
+	emit(buf, { 0x48, 0x89, 0xC2, 0x4C, 0x29, 0xEA, 0x48, 0x0F, 0x43, 0xC2 });
+}
+
+/**
+ * @brief Get a memory operand for the cell at r12 + offset.
+ * On a ring mapping the offset goes straight into the displacement, otherwise
+ * the wrapped location is computed into rax.
+ * 
+ * @param buf code buffer
+ * @param offset bound offset in [0, memsize), or any offset known to stay
+ * inside memory (DIRECT instructions)
+ * @param ring memory is a ring mapping, or the offset needs no wrapping
+ * @return memory operand
+ */
+cell_ref emit_addr(code_buf &buf, int64_t offset, bool ring) {
+	if (offset == 0) return { IDX_R12, 0 };
+	if (ring && offset <= INT32_MAX) return { IDX_R12, (int32_t)offset };
+
+	if (ring) {
+		// mov rax, imm64; add rax, r12
+		emit(buf, { 0x48, 0xB8 });
+		emit_u64(buf, (uint64_t)offset);
+		emit(buf, { 0x4C, 0x01, 0xE0 });
+	} else {
+		emit_wrap(buf, offset);
+	}
+
+	return { IDX_RAX, 0 };
+}
+
+/**
+ * @brief Emit an instruction with a cell memory operand.
+ * 
+ * @param buf code buffer
+ * @param rex REX prefix bits (0 for none)
+ * @param opcode opcode bytes
+ * @param reg ModRM reg field
+ * @param ref memory operand
+ */
+void emit_cell(code_buf &buf, uint8_t rex, std::initializer_list<uint8_t> opcode, uint8_t reg, cell_ref ref) {
+	if (ref.idx == IDX_R12) rex |= 0x42;
+	if (rex) buf.push_back(rex);
+	emit(buf, opcode);
+	// ModRM: [SIB] or [SIB + disp32]; SIB: base rbx, index rax or r12
+	buf.push_back(((ref.disp != 0) ? 0x84 : 0x04) | (reg << 3));
+	buf.push_back((ref.idx == IDX_R12) ? 0x23 : 0x03);
+	if (ref.disp != 0) emit_u32(buf, (uint32_t)ref.disp);
+}
+
+/**
+ * @brief Emit an absolute call.
+ * 
+ * @param buf code buffer
+ * @param fn function address
+ */
+void emit_call(code_buf &buf, const void *fn) {
+	// mov rax, imm64; call rax
+	emit(buf, { 0x48, 0xB8 });
+	emit_u64(buf, (uint64_t)fn);
+	emit(buf, { 0xFF, 0xD0 });
+}
+
+/**
+ * @brief Emit code that widens the pointer bounds to include a location.
+ * 
+ * @param buf code buffer
+ * @param offset location relative to r12, which must lie within the memory
+ */
+void emit_track(code_buf &buf, int32_t offset) {
+	// mov rcx, [rsp]; mov rcx, [rcx + 16]; lea rax, [r12 + rcx + offset]
+	emit(buf, { 0x48, 0x8B, 0x0C, 0x24, 0x48, 0x8B, 0x49, 0x10, 0x49, 0x8D, 0x84, 0x0C });
+	emit_u32(buf, (uint32_t)offset);
+	// mov rdx, rax; sub rdx, r13; cmovae rax, rdx
+	emit(buf, { 0x48, 0x89, 0xC2, 0x4C, 0x29, 0xEA, 0x48, 0x0F, 0x43, 0xC2 });
+	// cmp rax, r15; cmovb r15, rax; cmp rax, rbp; cmova rbp, rax
+	emit(buf, { 0x4C, 0x39, 0xF8, 0x4C, 0x0F, 0x42, 0xF8 });
+	emit(buf, { 0x48, 0x39, 0xE8, 0x48, 0x0F, 0x47, 0xE8 });
+}
+
+/**
+ * @brief Overwrite a previously emitted 32-bit value.
+ * 
+ * @param buf code buffer
+ * @param pos location of the value
+ * @param value new value
+ */
+void patch_u32(code_buf &buf, size_t pos, uint32_t value) {
+	for (int i = 0; i < 4; i++) buf[pos + i] = value >> (i * 8);
+}
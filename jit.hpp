@@ -0,0 +1,56 @@
+/**
+ * @file jit.hpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief x86-64 JIT compiler for brainfuck bytecode.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef BFI_JIT_HPP
+#define BFI_JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "compiler.hpp"
+
+/**
+ * @brief Compiled function: runs the program and returns the final pointer.
+ * bounds holds the lowest and highest pointer locations reached, and is
+ * widened by every MOVE and SCAN. Locations are rotated by bounds[2] first:
+ * (location + bounds[2]) % memsize.
+ * 
+ */
+typedef uint64_t (*bf_jit_fn)(uint8_t *mem, uint64_t ptr, uint64_t memsize, void *ctx, uint64_t *bounds);
+
+/**
+ * @brief Executable code buffer.
+ * 
+ */
+struct bf_jit_code {
+	bf_jit_fn fn;
+	void *buf;
+	size_t size;
+};
+
+/**
+ * @brief Compile a bound program to native code.
+ * Only supports 8-bit cells.
+ * 
+ * @param prog bound program
+ * @param rt runtime functions
+ * @param ring memory is a ring mapping, so cell offsets need no wrapping
+ * @param code output code buffer
+ * @return 0 - success; -1 - unsupported architecture or mapping failed
+ */
+int bf_jit_compile(const bf_program &prog, const bf_runtime &rt, bool ring, bf_jit_code &code);
+
+/**
+ * @brief Release a code buffer.
+ * 
+ * @param code code buffer
+ */
+void bf_jit_free(bf_jit_code &code);
+
+#endif // BFI_JIT_HPP
@@ -13,10 +13,15 @@
 #include <stack>
 #include <string>
 #include <istream>
-#include <fstream>
 #include <sstream>
 #include <cstring>
+#include <cctype>
+#include <cerrno>
+#include <string_view>
+#include <fcntl.h>
 #include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "bf.hpp"
@@ -27,6 +32,8 @@
 
 static int newline = 0;
 static int interactive = 0;
+static int stats = 0;
+static int async_output = 0;
 
 enum state {
 	NO_INPUT,
@@ -44,25 +51,42 @@ struct option long_opts[] = {
 	{"bytes",	required_argument,	0, 'm'},
 	{"newline",	no_argument,		0, 'n'},
 	{"shell",	no_argument,		0, 'i'},
-	{"repl",	no_argument,		0, 'i'}
+	{"repl",	no_argument,		0, 'i'},
+	{"engine",	required_argument,	0, 'e'},
+	{"compile",	no_argument,		0, 'c'},
+	{"cell-bits",	required_argument,	0, 'b'},
+	{"hugepages",	required_argument,	0, 'H'},
+	{"stats",	no_argument,		0, 's'},
+	{"eof",		required_argument,	0, 'E'},
+	{"input",	required_argument,	0, 'I'},
+	{"async-output",	no_argument,	0, 'A'},
+	{0,			0,					0, 0}
 };
 #endif
 
 void usage(int e);
 void version();
+int parse_size(const char *str, uint64_t &size);
+int load_file(const char *path, std::string &buf, std::string_view &code);
+void unload_file(const std::string &buf, std::string_view code);
 
 int main(int argc, char **argv) {
 	uint64_t mem_size = MEM_DEFAULT;
+	enum bf_memory mem_type = MEMORY_FIXED;
+	enum bf_engine engine = ENGINE_SWITCH;
+	int aot = 0;
+	int cell_bits = 8;
 	enum state st = ::NO_INPUT;
 
-	char *filepath;
-	char *arg_input;
+	char *filepath = NULL;
+	char *arg_input = NULL;
+	char *input_path = NULL;
 
 	char opt;
 	#ifdef __GNU_LIBRARY__
-	while ((opt = getopt_long(argc, argv, "hvf:m:in", long_opts, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "hvf:m:ine:cb:H:sE:I:A", long_opts, NULL)) != -1) {
 	#else
-	while ((opt = getopt(argc, argv, "hvf:m:in")) != -1) {
+	while ((opt = getopt(argc, argv, "hvf:m:ine:cb:H:sE:I:A")) != -1) {
 	#endif
 		switch (opt) {
 			case 'h':
@@ -76,7 +100,12 @@ int main(int argc, char **argv) {
 				st = ::FILE_INPUT;
 				break;
 			case 'm':
-				mem_size = atoi(optarg);
+				if (strcmp(optarg, "unbounded") == 0) {
+					mem_type = MEMORY_UNBOUNDED;
+				} else if (parse_size(optarg, mem_size) < 0) {
+					std::cerr << "Invalid memory size: " << optarg << std::endl;
+					usage(1);
+				}
 				break;
 			case 'i':
 				interactive = 1;
@@ -84,16 +113,74 @@ int main(int argc, char **argv) {
 			case 'n':
 				newline = 1;
 				break;
+			case 'e':
+				if (strcmp(optarg, "switch") == 0) {
+					engine = ENGINE_SWITCH;
+				} else if (strcmp(optarg, "threaded") == 0) {
+					engine = ENGINE_THREADED;
+				} else if (strcmp(optarg, "jit") == 0) {
+					engine = ENGINE_JIT;
+				} else {
+					std::cerr << "Unknown engine: " << optarg << std::endl;
+					usage(1);
+				}
+				break;
+			case 'c':
+				aot = 1;
+				break;
+			case 'b':
+				if (strcmp(optarg, "8") == 0) {
+					cell_bits = 8;
+				} else if (strcmp(optarg, "16") == 0) {
+					cell_bits = 16;
+				} else if (strcmp(optarg, "32") == 0) {
+					cell_bits = 32;
+				} else if (strcmp(optarg, "64") == 0) {
+					cell_bits = 64;
+				} else {
+					std::cerr << "Unsupported cell width: " << optarg << std::endl;
+					usage(1);
+				}
+				break;
+			case 's':
+				stats = 1;
+				break;
+			case 'H':
+				if (strcmp(optarg, "auto") == 0) {
+					bf_set_hugepages(HUGEPAGES_AUTO);
+				} else if (strcmp(optarg, "never") == 0) {
+					bf_set_hugepages(HUGEPAGES_NEVER);
+				} else if (strcmp(optarg, "always") == 0) {
+					bf_set_hugepages(HUGEPAGES_ALWAYS);
+				} else {
+					std::cerr << "Unknown huge page policy: " << optarg << std::endl;
+					usage(1);
+				}
+				break;
+			case 'E':
+				if (strcmp(optarg, "unchanged") == 0) {
+					bf_set_eof(EOF_UNCHANGED);
+				} else if (strcmp(optarg, "0") == 0) {
+					bf_set_eof(EOF_ZERO);
+				} else if (strcmp(optarg, "-1") == 0) {
+					bf_set_eof(EOF_MINUS_ONE);
+				} else {
+					std::cerr << "Unknown end of input mode: " << optarg << std::endl;
+					usage(1);
+				}
+				break;
+			case 'I':
+				input_path = optarg;
+				break;
+			case 'A':
+				async_output = 1;
+				break;
 			case '?':
 				usage(1);
 				break;
 		}
 	}
 
-	if (!isatty(fileno(stdin))) {
-		st = ::PIPED_INPUT;
-	}
-
 	if (optind < argc) {
 		if (st == ::FILE_INPUT) {
 			std::cerr << "warning: -f flag is set, ignoring CLI argument" << std::endl;
@@ -101,26 +188,50 @@ int main(int argc, char **argv) {
 			st = ::ARG_INPUT;
 			arg_input = argv[optind];
 		}
-	} else {
-		if (st == ::NO_INPUT) {
+	}
+
+	// stdin holds the program only if there is no other, otherwise it is data
+	if (st == ::NO_INPUT) {
+		if (isatty(fileno(stdin))) {
 			interactive = 1;
+		} else {
+			st = ::PIPED_INPUT;
 		}
 	}
 
+	if (input_path != NULL && bf_open_input(input_path) < 0) {
+		std::cerr << "Cannot read " << input_path << ": " << strerror(errno) << std::endl;
+		exit(1);
+	}
+
+	// compile whole programs only, the shell would fill the cache with lines
+	bf_set_engine(aot ? ENGINE_AOT : engine);
+
 	// initialize memory
-	if (bf_malloc(mem_size) < 0) {
+	if (bf_malloc(mem_size, mem_type, cell_bits) < 0) {
 		std::cerr << "Failed to allocate memory" << std::endl;
 		exit(1);
 	}
 
+	if (async_output && bf_start_writer() < 0) {
+		std::cerr << "warning: cannot start output thread, writing output directly" << std::endl;
+	}
+
 	// run code
 	if (st == ::ARG_INPUT) {
 		std::istringstream bf_code(arg_input);
 		bf_execute(bf_code);
 	}
 	if (st == ::FILE_INPUT) {
-		std::ifstream bf_code(filepath);
+		std::string buf;
+		std::string_view bf_code;
+		if (load_file(filepath, buf, bf_code) < 0) {
+			std::cerr << "Cannot read " << filepath << ": " << strerror(errno) << std::endl;
+			exit(1);
+		}
+
 		bf_execute(bf_code);
+		unload_file(buf, bf_code);
 	}
 	if (st == ::PIPED_INPUT) {
 		// Read piped input to string stream
@@ -128,7 +239,7 @@ int main(int argc, char **argv) {
 		std::string s(std::istreambuf_iterator<char>(std::cin), eos);
 		std::istringstream bf_code(s);
 
-		// Redirect stdin
+		// Redirect stdin, without a terminal (cron, containers) input is just empty
 		freopen("/dev/tty", "r", stdin);
 
 		bf_execute(bf_code);
@@ -138,10 +249,17 @@ int main(int argc, char **argv) {
 		std::cout << std::endl;
 	}
 	if (interactive) {
+		bf_set_engine(engine);
 		shell(newline);
 	}
+	if (stats) {
+		std::cerr << "memory: " << bf_memsize() << " cells, " << bf_cellbits() << " bits, "
+			<< bf_hugebytes() / 1024 << " kB in huge pages" << std::endl;
+	}
 
 	// exit
+	bf_stop_writer();
+	bf_close_input();
 	bf_free();
 	return 0;
 }
@@ -159,19 +277,125 @@ void usage(int e) {
 	#ifdef __GNU_LIBRARY__
 	std::cout << "  " << "-h, --help" << "\t\t\t" << "print usage" << std::endl;
 	std::cout << "  " << "-f, --file <filepath>" << "\t\t" << "execute code from a file" << std::endl;
-	std::cout << "  " << "-m, --memory, bytes <size>" << "\t" << "specify memory size in bytes (default: 30000)" << std::endl;
+	std::cout << "  " << "-m, --memory, bytes <size>" << "\t" << "memory size in cells, K/M/G/T suffixes, or 'unbounded' (default: 30000)" << std::endl;
 	std::cout << "  " << "-i, --shell, repl" << "\t\t" << "interactive REPL shell" << std::endl;
 	std::cout << "  " << "-n, --newline" << "\t\t\t" << "print newline at the end the program & toggle newline for shell" << std::endl;
+	std::cout << "  " << "-e, --engine <engine>" << "\t\t" << "execution engine: switch, threaded, jit (default: switch)" << std::endl;
+	std::cout << "  " << "-c, --compile" << "\t\t\t" << "compile to native code with cc, cached in $XDG_CACHE_HOME/bfi" << std::endl;
+	std::cout << "  " << "-b, --cell-bits <bits>" << "\t" << "cell width: 8, 16, 32, 64 (default: 8)" << std::endl;
+	std::cout << "  " << "-H, --hugepages <policy>" << "\t" << "huge pages for memory: auto, never, always (default: auto)" << std::endl;
+	std::cout << "  " << "-s, --stats" << "\t\t\t" << "print memory statistics to stderr on exit" << std::endl;
+	std::cout << "  " << "-E, --eof <mode>" << "\t\t" << "cell value on end of input: unchanged, 0, -1 (default: unchanged)" << std::endl;
+	std::cout << "  " << "-I, --input <filepath>" << "\t" << "read program input from a file instead of stdin" << std::endl;
+	std::cout << "  " << "-A, --async-output" << "\t\t" << "write output from a separate thread" << std::endl;
 	#else
 	std::cout << "  " << "-h" << "\t\t\t" << "print usage" << std::endl;
 	std::cout << "  " << "-f <filepath>" << "\t\t" << "execute code from a file" << std::endl;
-	std::cout << "  " << "-m <size>" << "\t\t" << "specify memory size in bytes (default: 30000)" << std::endl;
+	std::cout << "  " << "-m <size>" << "\t\t" << "memory size in cells, K/M/G/T suffixes, or 'unbounded' (default: 30000)" << std::endl;
 	std::cout << "  " << "-i" << "\t\t\t" << "interactive REPL shell" << std::endl;
 	std::cout << "  " << "-n" << "\t\t\t" << "print newline at the end the program & toggle newline for shell" << std::endl;
+	std::cout << "  " << "-e <engine>" << "\t\t" << "execution engine: switch, threaded, jit (default: switch)" << std::endl;
+	std::cout << "  " << "-c" << "\t\t\t" << "compile to native code with cc, cached in $XDG_CACHE_HOME/bfi" << std::endl;
+	std::cout << "  " << "-b <bits>" << "\t\t" << "cell width: 8, 16, 32, 64 (default: 8)" << std::endl;
+	std::cout << "  " << "-H <policy>" << "\t\t" << "huge pages for memory: auto, never, always (default: auto)" << std::endl;
+	std::cout << "  " << "-s" << "\t\t\t" << "print memory statistics to stderr on exit" << std::endl;
+	std::cout << "  " << "-E <mode>" << "\t\t" << "cell value on end of input: unchanged, 0, -1 (default: unchanged)" << std::endl;
+	std::cout << "  " << "-I <filepath>" << "\t\t" << "read program input from a file instead of stdin" << std::endl;
+	std::cout << "  " << "-A" << "\t\t\t" << "write output from a separate thread" << std::endl;
 	#endif
 	exit(e);
 }
 
+/**
+ * @brief Parse a size with an optional K, M, G or T (binary) suffix.
+ * 
+ * @param str size string
+ * @param size output size
+ * @return 0 - success; -1 - invalid or out of range
+ */
+int parse_size(const char *str, uint64_t &size) {
+	if (!isdigit((unsigned char)str[0])) return -1;
+
+	char *end;
+	errno = 0;
+	unsigned long long value = strtoull(str, &end, 10);
+	if (errno != 0 || value == 0) return -1;
+
+	int shift = 0;
+	switch (toupper((unsigned char)*end)) {
+		case 'K': shift = 10; break;
+		case 'M': shift = 20; break;
+		case 'G': shift = 30; break;
+		case 'T': shift = 40; break;
+		case '\0': break;
+		default: return -1;
+	}
+	if (shift != 0 && *++end != '\0') return -1;
+	if (value > (UINT64_MAX >> shift)) return -1;
+
+	size = (uint64_t)value << shift;
+	return 0;
+}
+
+/**
+ * @brief Map a program file into memory.
+ * Files that cannot be mapped, like pipes, are read into buf instead.
+ * 
+ * @param path file path
+ * @param buf storage for files that are not mapped
+ * @param code output file contents
+ * @return 0 - success; -1 - error (see errno)
+ */
+int load_file(const char *path, std::string &buf, std::string_view &code) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return -1;
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return -1;
+	}
+
+	if (S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapping != MAP_FAILED) {
+			madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+			close(fd);
+			code = std::string_view((const char *)mapping, st.st_size);
+			return 0;
+		}
+	}
+
+	char chunk[64 * 1024];
+	ssize_t got;
+	while ((got = read(fd, chunk, sizeof(chunk))) != 0) {
+		if (got < 0 && errno == EINTR) continue;
+		if (got < 0) {
+			int err = errno;
+			close(fd);
+			errno = err;
+			return -1;
+		}
+		buf.append(chunk, got);
+	}
+
+	close(fd);
+	code = buf;
+	return 0;
+}
+
+/**
+ * @brief Release a program file loaded by load_file.
+ * 
+ * @param buf storage passed to load_file
+ * @param code file contents
+ */
+void unload_file(const std::string &buf, std::string_view code) {
+	if (!code.empty() && code.data() != buf.data()) munmap((void *)code.data(), code.size());
+}
+
 /**
  * @brief Print program version and exit.
  * 
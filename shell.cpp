@@ -68,22 +68,22 @@ int shell_cmd(std::string input) {
 				std::cout << bf_ptr() << std::endl;
 				break;
 			case 'x':
-				printf("0x%.2x\n", bf_value());
+				printf("0x%.*llx\n", bf_cellbits() / 4, (unsigned long long)bf_value());
 				break;
 			case 'd':
-				printf("%d\n", bf_value());
+				printf("%llu\n", (unsigned long long)bf_value());
 				break;
 			case 'w':
 				std::cout << "val: \t";
 				for (int i = 0; i < 5; i++) {
 					int offset = i - SHELL_WINDOW_SIZE / 2;
-					printf(" 0x%.2x ", bf_value(bf_ptroffset(offset)));
+					printf(" 0x%.*llx ", bf_cellbits() / 4, (unsigned long long)bf_value(bf_ptroffset(offset)));
 				}
 				std::cout << std::endl;
 				std::cout << "ptr: \t";
 				for (int i = 0; i < 5; i++) {
 					int offset = i - SHELL_WINDOW_SIZE / 2;
-					printf(" %-4lu ", bf_ptroffset(offset) % 10000);
+					printf(" %-*lu ", bf_cellbits() / 4 + 2, bf_ptroffset(offset) % 10000);
 				}
 				std::cout << std::endl;
 				break;
@@ -96,10 +96,28 @@ int shell_cmd(std::string input) {
 					newlines = 1;
 				}
 				break;
+			case 'm':
+				std::cout << "Memory: " << bf_memsize() << " cells, " << bf_cellbits() << " bits" << std::endl;
+				std::cout << "Huge pages: " << bf_hugebytes() / 1024 << " kB" << std::endl;
+				break;
 			case 'r':
 				bf_reset();
 				std::cout << "Memory zeroed" << std::endl;
 				break;
+			case 's':
+				if (bf_snapshot() < 0) {
+					std::cout << "Snapshot too large" << std::endl;
+				} else {
+					std::cout << "Snapshot saved" << std::endl;
+				}
+				break;
+			case 'u':
+				if (bf_restore() < 0) {
+					std::cout << "No snapshot" << std::endl;
+				} else {
+					std::cout << "Snapshot restored" << std::endl;
+				}
+				break;
 			default:
 				std::cout << "Unknown command: " << cmd << std::endl;
 		}
@@ -124,5 +142,8 @@ void shell_help() {
 	std::cout << "  d" << "\t" << "Print current cell value in decimal" << std::endl;
 	std::cout << "  w" << "\t" << "Print window" << std::endl;
 	std::cout << "  n" << "\t" << "Toggle newlines (after code is executed)" << std::endl;
+	std::cout << "  m" << "\t" << "Print memory size and huge page usage" << std::endl;
 	std::cout << "  r" << "\t" << "Reset (zero) memory and return pointer to 0" << std::endl;
+	std::cout << "  s" << "\t" << "Save a snapshot of memory and pointer" << std::endl;
+	std::cout << "  u" << "\t" << "Restore the last snapshot" << std::endl;
 }
@@ -0,0 +1,458 @@
+/**
+ * @file tape.cpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief Brainfuck memory allocation.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#include "tape.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+// sparse memory, for sizes at least this many bytes
+#define SPARSE_MIN (16ULL << 20)
+
+// huge pages, automatically used for sizes at least HUGEPAGE_MIN bytes
+#define HUGEPAGE_SIZE (2ULL << 20)
+#define HUGEPAGE_MIN (64ULL << 20)
+
+// cleared ranges at least this many bytes are released instead of zeroed
+#define RELEASE_MIN (256 * 1024)
+
+// unbounded memory
+#define UNBOUNDED_MAX (1ULL << 36)
+#define UNBOUNDED_MIN (1ULL << 30)
+#define COMMIT_CHUNK (64 * 1024)
+#define MAX_RESERVED 16
+
+/**
+ * @brief Address range committed on demand.
+ * 
+ */
+struct reserved_range {
+	std::atomic<uint8_t *> base;	// published last, NULL while the slot is free
+	uint64_t size;	// read by the fault handler only after base
+	uint8_t *committed;	// one flag per chunk
+};
+
+static reserved_range reserved[MAX_RESERVED];
+static struct sigaction prev_segv;
+static struct sigaction prev_bus;
+static int handler_installed = 0;
+static std::mutex reserved_lock;	// slot claims and handler install, not taken by the handler
+static std::atomic<int> active_faults{0};	// handlers that may be reading a slot
+
+int alloc_ring(bf_tape &tape, uint64_t size, unsigned cell_size);
+int alloc_sparse(bf_tape &tape, uint64_t size, unsigned cell_size, bool advise);
+int alloc_hugetlb(bf_tape &tape, uint64_t size, unsigned cell_size);
+int advise_huge(uint8_t *mem, uint64_t bytes);
+void release(bf_tape &tape, uint8_t *mem, uint64_t bytes);
+int install_handler();
+void commit_fault(int sig, siginfo_t *info, void *ucontext);
+
+int bf_tape_alloc(bf_tape &tape, uint64_t size, unsigned cell_size, enum bf_hugepages policy) {
+	if (size == 0 || size > UINT64_MAX / cell_size - HUGEPAGE_SIZE) return -1;
+	uint64_t bytes = size * cell_size;
+
+	if (policy == HUGEPAGES_ALWAYS || (policy == HUGEPAGES_AUTO && bytes >= HUGEPAGE_MIN)) {
+		if (policy == HUGEPAGES_ALWAYS && alloc_hugetlb(tape, size, cell_size) == 0) return 0;
+		return alloc_sparse(tape, size, cell_size, true);
+	}
+	if (bytes >= SPARSE_MIN) return alloc_sparse(tape, size, cell_size, false);
+	if (alloc_ring(tape, size, cell_size) == 0) return 0;
+
+	tape.mem = (uint8_t *)std::calloc(size, cell_size);
+	if (tape.mem == NULL) return -1;
+
+	tape.size = size;
+	tape.bytes = size * cell_size;
+	tape.cell_size = cell_size;
+	tape.type = TAPE_HEAP;
+	tape.huge = HUGE_NONE;
+	return 0;
+}
+
+int bf_tape_alloc_unbounded(bf_tape &tape, unsigned cell_size) {
+	std::lock_guard<std::mutex> guard(reserved_lock);
+	if (install_handler() < 0) return -1;
+
+	int slot = 0;
+	while (slot < MAX_RESERVED && reserved[slot].base != NULL) slot++;
+	if (slot == MAX_RESERVED) return -1;
+
+	// take the largest range the system lets us reserve
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+	for (uint64_t size = UNBOUNDED_MAX; size >= UNBOUNDED_MIN; size /= 2) {
+		void *base = mmap(NULL, size, PROT_NONE, flags, -1, 0);
+		if (base == MAP_FAILED) continue;
+
+		// chunk flags are set from the fault handler, so they cannot be allocated there
+		void *flags_map = mmap(NULL, size / COMMIT_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (flags_map == MAP_FAILED) {
+			munmap(base, size);
+			return -1;
+		}
+
+		reserved[slot].size = size;
+		reserved[slot].committed = (uint8_t *)flags_map;
+		reserved[slot].base.store((uint8_t *)base, std::memory_order_release);
+		tape.mem = (uint8_t *)base;
+		tape.size = size / cell_size;
+		tape.bytes = size;
+		tape.cell_size = cell_size;
+		tape.type = TAPE_UNBOUNDED;
+		tape.huge = HUGE_NONE;
+		return 0;
+	}
+
+	return -1;
+}
+
+void bf_tape_clear(bf_tape &tape) {
+	// reserved huge pages are dropped too where the kernel supports it, mapping
+	// fresh ones on top could fail if the pool is short
+	if (tape.type == TAPE_UNBOUNDED || tape.type == TAPE_SPARSE) {
+		release(tape, tape.mem, tape.bytes);
+		return;
+	}
+
+	std::memset(tape.mem, 0, tape.bytes);
+}
+
+void bf_tape_clear_range(bf_tape &tape, uint64_t start, uint64_t count) {
+	uint8_t *begin = tape.mem + start * tape.cell_size;
+	uint8_t *end = begin + count * tape.cell_size;
+
+	bool releasable = (tape.type == TAPE_SPARSE && tape.huge != HUGE_HUGETLB) || tape.type == TAPE_UNBOUNDED;
+	if (!releasable || (uint64_t)(end - begin) < RELEASE_MIN) {
+		std::memset(begin, 0, end - begin);
+		return;
+	}
+
+	// zero the partial pages at both ends, release the whole ones in between
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uint8_t *first = (uint8_t *)(((uintptr_t)begin + page - 1) & ~(page - 1));
+	uint8_t *last = (uint8_t *)((uintptr_t)end & ~(page - 1));
+	std::memset(begin, 0, first - begin);
+	std::memset(last, 0, end - last);
+	release(tape, first, last - first);
+}
+
+uint64_t bf_tape_run(const bf_tape &tape, uint64_t start, uint64_t count, bool &committed) {
+	committed = true;
+	if (tape.type != TAPE_UNBOUNDED) return count;
+
+	const reserved_range *range = NULL;
+	for (const reserved_range &slot : reserved) {
+		if (slot.base == tape.mem) range = &slot;
+	}
+	if (range == NULL) return count;
+
+	uint64_t byte = start * tape.cell_size;
+	uint64_t end = (start + count) * tape.cell_size;
+	uint64_t chunk = byte / COMMIT_CHUNK;
+	committed = range->committed[chunk] != 0;
+
+	// extend over following chunks in the same state
+	uint64_t stop = (chunk + 1) * COMMIT_CHUNK;
+	while (stop < end && (range->committed[stop / COMMIT_CHUNK] != 0) == committed) stop += COMMIT_CHUNK;
+	if (stop > end) stop = end;
+
+	return (stop - byte) / tape.cell_size;
+}
+
+uint64_t bf_tape_huge_bytes(const bf_tape &tape) {
+	if (tape.mem == NULL) return 0;
+
+	std::ifstream smaps("/proc/self/smaps");
+	uint8_t *end = tape.mem + tape.bytes;
+	bool inside = false;
+	uint64_t total = 0;
+
+	// sum huge page fields of every mapping that overlaps the tape
+	std::string line;
+	while (std::getline(smaps, line)) {
+		unsigned long long start, stop, kb;
+		char field[32];
+		if (std::sscanf(line.c_str(), "%llx-%llx ", &start, &stop) == 2) {
+			inside = (uint8_t *)stop > tape.mem && (uint8_t *)start < end;
+		} else if (inside && std::sscanf(line.c_str(), "%31[^:]: %llu kB", field, &kb) == 2) {
+			if (std::strcmp(field, "AnonHugePages") == 0
+				|| std::strcmp(field, "Private_Hugetlb") == 0
+				|| std::strcmp(field, "Shared_Hugetlb") == 0) {
+				total += kb * 1024;
+			}
+		}
+	}
+
+	return total;
+}
+
+void bf_tape_free(bf_tape &tape) {
+	if (tape.mem == NULL) return;
+
+	if (tape.type == TAPE_RING) {
+		munmap(tape.mem, 2 * tape.bytes);
+	} else if (tape.type == TAPE_SPARSE) {
+		munmap(tape.mem, tape.bytes);
+	} else if (tape.type == TAPE_UNBOUNDED) {
+		std::lock_guard<std::mutex> guard(reserved_lock);
+		for (reserved_range &range : reserved) {
+			if (range.base != tape.mem) continue;
+			range.base = NULL;
+
+			// a handler that saw the old base may still be using the slot
+			while (active_faults.load() != 0) sched_yield();
+			munmap(range.committed, range.size / COMMIT_CHUNK);
+		}
+		munmap(tape.mem, tape.bytes);
+	} else {
+		std::free(tape.mem);
+	}
+	tape.mem = NULL;
+}
+
+/** Internal Functions **/
+
+/**
+ * @brief Map the same memfd pages twice, back to back.
+ * A location up to 2 * size - 1 then needs no wrapping to be accessed.
+ * 
+ * @param tape output tape
+ * @param size memory size in cells, rounded up to a page multiple
+ * @param cell_size cell size in bytes
+ * @return 0 - success; -1 - not supported or error
+ */
+int alloc_ring(bf_tape &tape, uint64_t size, unsigned cell_size) {
+#ifdef __linux__
+	uint64_t page = sysconf(_SC_PAGESIZE);
+	uint64_t bytes = (size * cell_size + page - 1) / page * page;
+	if (bytes == 0) return -1;
+
+	int fd = memfd_create("bfi-tape", MFD_CLOEXEC);
+	if (fd < 0) return -1;
+	if (ftruncate(fd, bytes) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	// reserve the whole range, then put both views over it
+	uint8_t *base = (uint8_t *)mmap(NULL, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+
+	int flags = MAP_SHARED | MAP_FIXED;
+	if (mmap(base, bytes, PROT_READ | PROT_WRITE, flags, fd, 0) == MAP_FAILED
+		|| mmap(base + bytes, bytes, PROT_READ | PROT_WRITE, flags, fd, 0) == MAP_FAILED) {
+		munmap(base, 2 * bytes);
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	tape.mem = base;
+	tape.size = bytes / cell_size;
+	tape.bytes = bytes;
+	tape.cell_size = cell_size;
+	tape.type = TAPE_RING;
+	tape.huge = HUGE_NONE;
+	return 0;
+#else
+	(void)tape;
+	(void)size;
+	(void)cell_size;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Map anonymous memory without reserving swap for it.
+ * Pages are zero-filled by the kernel on first access, so neither startup time
+ * nor resident memory depends on size.
+ * 
+ * @param tape output tape
+ * @param size memory size in cells
+ * @param cell_size cell size in bytes
+ * @param advise align to 2 MiB and advise for transparent huge pages
+ * @return 0 - success; -1 - error
+ */
+int alloc_sparse(bf_tape &tape, uint64_t size, unsigned cell_size, bool advise) {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+	if (advise) {
+		// over-map by a huge page, then trim to an aligned range
+		uint64_t bytes = (size * cell_size + HUGEPAGE_SIZE - 1) / HUGEPAGE_SIZE * HUGEPAGE_SIZE;
+		uint8_t *base = (uint8_t *)mmap(NULL, bytes + HUGEPAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (base == MAP_FAILED) return -1;
+
+		uint8_t *mem = (uint8_t *)(((uintptr_t)base + HUGEPAGE_SIZE - 1) & ~(uintptr_t)(HUGEPAGE_SIZE - 1));
+		if (mem > base) munmap(base, mem - base);
+		munmap(mem + bytes, base + HUGEPAGE_SIZE - mem);
+
+		tape.mem = mem;
+		tape.size = size;
+		tape.bytes = bytes;
+		tape.cell_size = cell_size;
+		tape.type = TAPE_SPARSE;
+		tape.huge = (advise_huge(mem, bytes) == 0) ? HUGE_ADVISED : HUGE_NONE;
+		return 0;
+	}
+
+	void *base = mmap(NULL, size * cell_size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (base == MAP_FAILED) return -1;
+
+	tape.mem = (uint8_t *)base;
+	tape.size = size;
+	tape.bytes = size * cell_size;
+	tape.cell_size = cell_size;
+	tape.type = TAPE_SPARSE;
+	tape.huge = HUGE_NONE;
+	return 0;
+}
+
+/**
+ * @brief Map reserved huge pages.
+ * Fails unless the system has a huge page pool large enough.
+ * 
+ * @param tape output tape
+ * @param size memory size in cells
+ * @param cell_size cell size in bytes
+ * @return 0 - success; -1 - not supported or error
+ */
+int alloc_hugetlb(bf_tape &tape, uint64_t size, unsigned cell_size) {
+#ifdef MAP_HUGETLB
+	uint64_t bytes = (size * cell_size + HUGEPAGE_SIZE - 1) / HUGEPAGE_SIZE * HUGEPAGE_SIZE;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+	void *base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (base == MAP_FAILED) return -1;
+
+	tape.mem = (uint8_t *)base;
+	tape.size = size;
+	tape.bytes = bytes;
+	tape.cell_size = cell_size;
+	tape.type = TAPE_SPARSE;
+	tape.huge = HUGE_HUGETLB;
+	return 0;
+#else
+	(void)tape;
+	(void)size;
+	(void)cell_size;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Ask for transparent huge pages over a 2 MiB aligned range.
+ * 
+ * @param mem start address
+ * @param bytes length
+ * @return 0 - success; -1 - not supported or error
+ */
+int advise_huge(uint8_t *mem, uint64_t bytes) {
+#ifdef MADV_HUGEPAGE
+	return madvise(mem, bytes, MADV_HUGEPAGE);
+#else
+	(void)mem;
+	(void)bytes;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Drop whole pages of sparse or unbounded memory, so they read as zero.
+ * Zeroes them instead if they cannot be dropped (e.g. reserved huge pages on
+ * older kernels).
+ * 
+ * @param tape tape the pages belong to
+ * @param mem page aligned start address
+ * @param bytes page multiple length
+ */
+void release(bf_tape &tape, uint8_t *mem, uint64_t bytes) {
+#ifdef __linux__
+	// private anonymous pages are zero-filled again on the next access
+	(void)tape;
+	if (madvise(mem, bytes, MADV_DONTNEED) == 0) return;
+#else
+	// map a fresh range on top; unbounded memory goes back to being reserved
+	int prot = (tape.type == TAPE_UNBOUNDED) ? PROT_NONE : PROT_READ | PROT_WRITE;
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED;
+	if (mmap(mem, bytes, prot, flags, -1, 0) != MAP_FAILED) {
+		if (tape.huge == HUGE_ADVISED) advise_huge(mem, bytes);
+		return;
+	}
+#endif
+	std::memset(mem, 0, bytes);
+}
+
+/**
+ * @brief Install the fault handler for unbounded memory, once.
+ * 
+ * @return 0 - success; -1 - error
+ */
+int install_handler() {
+	if (handler_installed) return 0;
+
+	struct sigaction action;
+	std::memset(&action, 0, sizeof(action));
+	action.sa_sigaction = commit_fault;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+
+	// some systems report PROT_NONE faults as SIGBUS
+	if (sigaction(SIGSEGV, &action, &prev_segv) < 0) return -1;
+	if (sigaction(SIGBUS, &action, &prev_bus) < 0) return -1;
+
+	handler_installed = 1;
+	return 0;
+}
+
+/**
+ * @brief Fault handler: commit the chunk of a reserved range that was touched.
+ * Faults outside reserved ranges restore the previous handlers, so returning
+ * re-raises them as usual.
+ * 
+ * @param sig signal number
+ * @param info fault information
+ * @param ucontext unused
+ */
+void commit_fault(int sig, siginfo_t *info, void *ucontext) {
+	(void)ucontext;
+	uint8_t *addr = (uint8_t *)info->si_addr;
+
+	// counted before looking at any slot, bf_tape_free waits for it to drop
+	active_faults.fetch_add(1);
+	for (const reserved_range &range : reserved) {
+		uint8_t *base = range.base.load(std::memory_order_acquire);
+		if (base == NULL || addr < base || addr >= base + range.size) continue;
+
+		uint64_t offset = (addr - base) / COMMIT_CHUNK * COMMIT_CHUNK;
+		uint64_t len = range.size - offset < COMMIT_CHUNK ? range.size - offset : COMMIT_CHUNK;
+		if (mprotect(base + offset, len, PROT_READ | PROT_WRITE) < 0) break;
+
+		range.committed[offset / COMMIT_CHUNK] = 1;
+		active_faults.fetch_sub(1);
+		return;
+	}
+	active_faults.fetch_sub(1);
+
+	sigaction(SIGSEGV, &prev_segv, NULL);
+	sigaction(SIGBUS, &prev_bus, NULL);
+	(void)sig;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file tape.hpp
+ * @author Vladyslav Aviedov <vladaviedov@protonmail.com>
+ * @brief Brainfuck memory allocation.
+ * @date 2026-10-16
+ * 
+ * @copyright Copyright (c) 2022
+ * 
+ */
+#ifndef BFI_TAPE_HPP
+#define BFI_TAPE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bf.hpp"
+
+/**
+ * @brief Memory layouts.
+ * 
+ */
+enum bf_tape_type {
+	TAPE_HEAP,		// plain allocation, every access wraps explicitly
+	TAPE_RING,		// mapped twice back to back, cells [size, 2 * size) alias [0, size)
+	TAPE_SPARSE,	// large anonymous mapping, pages zero-filled on first access
+	TAPE_UNBOUNDED	// reserved address range, pages committed on first access
+};
+
+/**
+ * @brief Huge page backing.
+ * 
+ */
+enum bf_tape_huge {
+	HUGE_NONE,		// regular pages
+	HUGE_ADVISED,	// 2 MiB aligned and advised for transparent huge pages
+	HUGE_HUGETLB	// reserved huge pages
+};
+
+/**
+ * @brief Brainfuck memory.
+ * 
+ */
+struct bf_tape {
+	uint8_t *mem;
+	uint64_t size;		// in cells
+	uint64_t bytes;		// mapped length, at least size * cell_size
+	unsigned cell_size;	// in bytes
+	enum bf_tape_type type;
+	enum bf_tape_huge huge;
+};
+
+/**
+ * @brief Allocate zeroed memory.
+ * Uses a ring mapping where supported, which rounds size up to a page multiple.
+ * Large sizes use a sparse mapping instead, so only touched pages take memory.
+ * Huge pages are used for sparse mappings as allowed by the policy.
+ * 
+ * @param tape output tape
+ * @param size memory size in cells
+ * @param cell_size cell size in bytes
+ * @param policy huge page policy
+ * @return 0 - success; -1 - error
+ */
+int bf_tape_alloc(bf_tape &tape, uint64_t size, unsigned cell_size, enum bf_hugepages policy);
+
+/**
+ * @brief Reserve a large address range that is committed on demand.
+ * Touching an uncommitted page faults into a handler that commits it, so only
+ * memory the program actually uses costs anything.
+ * 
+ * @param tape output tape
+ * @param cell_size cell size in bytes
+ * @return 0 - success; -1 - error
+ */
+int bf_tape_alloc_unbounded(bf_tape &tape, unsigned cell_size);
+
+/**
+ * @brief Zero memory.
+ * 
+ * @param tape tape
+ */
+void bf_tape_clear(bf_tape &tape);
+
+/**
+ * @brief Zero a range of cells.
+ * Large ranges of sparse and unbounded memory are returned to the system
+ * instead of written to.
+ * 
+ * @param tape tape
+ * @param start first cell
+ * @param count number of cells, start + count must not exceed size
+ */
+void bf_tape_clear_range(bf_tape &tape, uint64_t start, uint64_t count);
+
+/**
+ * @brief Measure a run of cells that are either all committed or all never
+ * touched. Untouched cells of unbounded memory read as zero without having to
+ * commit them; every other tape is committed throughout.
+ * 
+ * @param tape tape
+ * @param start first cell
+ * @param count cells available from start
+ * @param committed set if the run is committed
+ * @return run length in cells, at least 1 for count > 0
+ */
+uint64_t bf_tape_run(const bf_tape &tape, uint64_t start, uint64_t count, bool &committed);
+
+/**
+ * @brief Get the amount of memory currently backed by huge pages.
+ * Read from /proc/self/smaps, 0 where that is not available.
+ * 
+ * @param tape tape
+ * @return size in bytes
+ */
+uint64_t bf_tape_huge_bytes(const bf_tape &tape);
+
+/**
+ * @brief Free memory.
+ * 
+ * @param tape tape
+ */
+void bf_tape_free(bf_tape &tape);
+
+#endif // BFI_TAPE_HPP